@@ -0,0 +1,250 @@
+#include "honk.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "honk_codec.h"
+#include "honk_container.h"
+#include "honk_io.h"
+
+//Near the end of the destination, the input is compressed this many bytes at a time into a scratch buffer first:
+#define TAIL_SLICE_SIZE ((size_t)1024)
+
+//The scratch buffer takes the tokens of a slice and of the pending block in front of it (a pending run is shorter):
+#define SCRATCH_SIZE (HONK_MAX_LONG_BLOCK + TAIL_SLICE_SIZE + (HONK_MAX_LONG_BLOCK + TAIL_SLICE_SIZE) / 3 + 16)
+
+//Longest input whose tokens are known to fit into the given capacity:
+static size_t get_safe_input_count(size_t capacity);
+
+//Append the tokens in the scratch output to the destination. Returns false if they do not fit.
+static bool append_scratch(honk_output_t* output, honk_output_t* scratch);
+
+//Get the size of the tokens in the destination, or HONK_ERROR_DST_TOO_SMALL if they have overflowed it:
+static int64_t get_result(const honk_output_t* output);
+
+//Tell why the decoder stopped in front of the given token: a full destination or a broken stream?
+static int64_t get_stop_error(const uint8_t* input, size_t input_count, bool is_wide);
+
+//Decompress a v2 container:
+static int64_t decompress_v2(const uint8_t* src, size_t src_count, uint8_t* dst, size_t dst_capacity);
+
+static size_t get_safe_input_count(size_t capacity)
+{
+	if (capacity < honk_compress_bound(0))
+	{
+		return 0;
+	}
+
+	//Invert the bound and correct the rounding:
+	size_t count = (capacity - honk_compress_bound(0)) / 4 * 3;
+
+	while (honk_compress_bound(count + 1) <= capacity)
+	{
+		count++;
+	}
+
+	return count;
+}
+
+static bool append_scratch(honk_output_t* output, honk_output_t* scratch)
+{
+	if (scratch->is_overflowed || (output->capacity - output->count < scratch->count))
+	{
+		return false;
+	}
+
+	memcpy(output->data + output->count, scratch->data, scratch->count);
+	honk_output_commit(output, scratch->count);
+
+	scratch->count = 0;
+	return true;
+}
+
+static int64_t get_result(const honk_output_t* output)
+{
+	//The bound rules this out, but a fixed output never writes beyond the destination either way:
+	return output->is_overflowed ? HONK_ERROR_DST_TOO_SMALL : (int64_t)output->count;
+}
+
+static int64_t get_stop_error(const uint8_t* input, size_t input_count, bool is_wide)
+{
+	honk_token_t token;
+
+	//A complete token is only left over if it does not fit:
+	if (honk_read_token(input, input_count, is_wide, &token) && (input_count >= token.size))
+	{
+		return HONK_ERROR_DST_TOO_SMALL;
+	}
+
+	return HONK_ERROR_BAD_FORMAT;
+}
+
+static int64_t decompress_v2(const uint8_t* src, size_t src_count, uint8_t* dst, size_t dst_capacity)
+{
+	honk_v2_header_t header;
+
+	if ((src_count < HONK_V2_HEADER_SIZE) || !honk_v2_read_header(src, &header))
+	{
+		return HONK_ERROR_BAD_FORMAT;
+	}
+
+	bool is_wide = honk_v2_has_wide_tokens(&header);
+	size_t i = HONK_V2_HEADER_SIZE;
+	size_t count = 0;
+
+	//Decode the chunks up to the end of chunks:
+	for (;;)
+	{
+		honk_v2_chunk_header_t chunk_header;
+
+		if ((src_count - i < HONK_V2_CHUNK_HEADER_SIZE) || !honk_v2_read_chunk_header(src + i, &chunk_header))
+		{
+			return HONK_ERROR_BAD_FORMAT;
+		}
+
+		i += HONK_V2_CHUNK_HEADER_SIZE;
+
+		if (chunk_header.payload_size == 0)
+		{
+			break;
+		}
+
+		if (src_count - i < chunk_header.payload_size)
+		{
+			return HONK_ERROR_BAD_FORMAT;
+		}
+
+		if (dst_capacity - count < chunk_header.uncompressed_size)
+		{
+			return HONK_ERROR_DST_TOO_SMALL;
+		}
+
+		//Stored chunks are copied as they are, the tokens of the others must decode to exactly the chunk:
+		if (chunk_header.is_stored)
+		{
+			memcpy(dst + count, src + i, chunk_header.payload_size);
+		}
+		else
+		{
+			size_t chunk_end = count + chunk_header.uncompressed_size;
+			size_t decoded_count = count;
+
+			if ((honk_decode_tokens(src + i, chunk_header.payload_size, dst, chunk_end, &decoded_count, is_wide) != chunk_header.payload_size) || (decoded_count != chunk_end))
+			{
+				return HONK_ERROR_BAD_FORMAT;
+			}
+		}
+
+		i += chunk_header.payload_size;
+		count += chunk_header.uncompressed_size;
+	}
+
+	if ((header.total_size != HONK_V2_UNKNOWN_SIZE) && (header.total_size != count))
+	{
+		return HONK_ERROR_BAD_FORMAT;
+	}
+
+	return (int64_t)count;
+}
+
+size_t honk_compress_bound(size_t src_count)
+{
+	//The worst case are single bytes between runs of two ("abbcdd..."), which take 4 bytes for every 3.
+	//The rest covers the last token and the room that the encoder reserves for the longest token header.
+	return src_count + src_count / 3 + 16;
+}
+
+int64_t honk_compress_buffer(const void* src, size_t src_count, void* dst, size_t dst_capacity, uint32_t flags)
+{
+	const uint8_t* bytes = src;
+	honk_encoder_t encoder;
+	honk_output_t output;
+
+	//The input stays where it is, so it is encoded like a mapped file.
+	//bytes[-1] is never read, as the encoder starts with an empty block.
+	honk_encoder_init_mapped(&encoder, (flags & HONK_FLAG_LONG_TOKENS) ? HONK_LAYOUT_LONG : HONK_LAYOUT_COMPAT);
+	honk_output_init_fixed(&output, dst, dst_capacity);
+
+	//Every prefix of the input takes no more than its bound, so it can be encoded straight into the destination:
+	size_t safe_count = get_safe_input_count(dst_capacity);
+
+	if (safe_count >= src_count)
+	{
+		honk_encoder_update(&encoder, bytes, src_count, &output);
+		honk_encoder_finish(&encoder, &output);
+
+		return get_result(&output);
+	}
+
+	honk_encoder_update(&encoder, bytes, safe_count, &output);
+
+	if (output.is_overflowed)
+	{
+		return HONK_ERROR_DST_TOO_SMALL;
+	}
+
+	//The rest goes through the scratch buffer, until it is done or does not fit:
+	uint8_t scratch_data[SCRATCH_SIZE];
+	honk_output_t scratch;
+
+	honk_output_init_fixed(&scratch, scratch_data, SCRATCH_SIZE);
+
+	for (size_t i = safe_count; i < src_count; i += TAIL_SLICE_SIZE)
+	{
+		size_t count = (src_count - i < TAIL_SLICE_SIZE) ? (src_count - i) : TAIL_SLICE_SIZE;
+		honk_encoder_update(&encoder, bytes + i, count, &scratch);
+
+		if (!append_scratch(&output, &scratch))
+		{
+			return HONK_ERROR_DST_TOO_SMALL;
+		}
+	}
+
+	honk_encoder_finish(&encoder, &scratch);
+
+	if (!append_scratch(&output, &scratch))
+	{
+		return HONK_ERROR_DST_TOO_SMALL;
+	}
+
+	return get_result(&output);
+}
+
+int64_t honk_decompress_buffer(const void* src, size_t src_count, void* dst, size_t dst_capacity)
+{
+	const uint8_t* input = src;
+
+	//V2 container or legacy stream?
+	if (honk_v2_has_magic(input, src_count))
+	{
+		return decompress_v2(input, src_count, dst, dst_capacity);
+	}
+
+	size_t count = 0;
+	size_t consumed = honk_decode_tokens(input, src_count, dst, dst_capacity, &count, false);
+
+	if (!honk_is_stream_tail(input + consumed, src_count - consumed, false))
+	{
+		return get_stop_error(input + consumed, src_count - consumed, false);
+	}
+
+	return (int64_t)count;
+}
+
+const char* honk_error_message(int64_t error)
+{
+	switch (error)
+	{
+	case HONK_ERROR_DST_TOO_SMALL:
+
+		return "Destination buffer is too small";
+
+	case HONK_ERROR_BAD_FORMAT:
+
+		return "Bad format";
+
+	default:
+
+		return (error >= 0) ? "No error" : "Unknown error";
+	}
+}
@@ -0,0 +1,165 @@
+#ifndef __HONK_H__
+#define __HONK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//The embeddable interface of libhonk: whole buffers in, whole buffers out (plus streams and readers of indexed files).
+//Apart from streams and readers, all memory comes from the caller. Errors are returned instead of ending the process.
+//The functions are reentrant, so any number of threads may call them at once.
+//The parallel codecs of honkpack, which quit on errors, are not part of the library.
+
+//Exported functions (everything else in libhonk is built with hidden visibility):
+#if defined(__GNUC__)
+#define HONK_API __attribute__((visibility("default")))
+#else
+#define HONK_API
+#endif
+
+//Errors (the functions return them instead of a size):
+#define HONK_ERROR_DST_TOO_SMALL ((int64_t)-1)
+#define HONK_ERROR_BAD_FORMAT ((int64_t)-2)
+
+//Largest compressed size of src_count bytes. A destination of this size never is too small.
+HONK_API size_t honk_compress_bound(size_t src_count);
+
+//Flags of the compressors (0 for none):
+//Write escape tokens for runs and blocks of more than 127 bytes, as honkpack --long does.
+//Such streams are shorter, but decoders without escape support decode them into wrong bytes.
+#define HONK_FLAG_LONG_TOKENS ((uint32_t)1)
+
+//Compress src_count bytes into a legacy stream at dst, which any honkpack -d decodes unless flags ask for long tokens.
+//Returns the compressed size or HONK_ERROR_DST_TOO_SMALL.
+HONK_API int64_t honk_compress_buffer(const void* src, size_t src_count, void* dst, size_t dst_capacity, uint32_t flags);
+
+//Decompress a legacy stream or a v2 container (the chunk table and the footer are not read) at src into dst.
+//Returns the decompressed size, HONK_ERROR_DST_TOO_SMALL or HONK_ERROR_BAD_FORMAT.
+HONK_API int64_t honk_decompress_buffer(const void* src, size_t src_count, void* dst, size_t dst_capacity);
+
+//A resumable compressor or decompressor for input that arrives in pieces.
+//It keeps the state machines of the codec between the calls and pauses within a token if the output is full.
+typedef struct __honk_stream_t__ honk_stream_t;
+
+typedef enum __honk_stream_mode_t__
+{
+	HONK_STREAM_COMPRESS,
+	HONK_STREAM_DECOMPRESS
+} honk_stream_mode_t;
+
+//A single call consumes and produces no more than this many bytes, so its work is bounded (e.g. for a long run):
+#define HONK_STREAM_STEP_SIZE ((size_t)64 << 10)
+
+//Start a stream (compressors write the same legacy stream as honk_compress_buffer() with the same flags, which decompressors ignore).
+//Returns NULL if it cannot be allocated.
+HONK_API honk_stream_t* honk_stream_create(honk_stream_mode_t mode, uint32_t flags);
+
+//Release a stream:
+HONK_API void honk_stream_destroy(honk_stream_t* stream);
+
+//Consume a prefix of the input (its size goes to in_consumed) and write output to out.
+//Returns the number of written bytes or an error, after which the stream is broken. Input that is not consumed must be passed again.
+HONK_API int64_t honk_stream_update(honk_stream_t* stream, const void* in, size_t in_count, size_t* in_consumed, void* out, size_t out_capacity);
+
+//End the input and write the rest of the output to out. Call it until it returns 0 (or an error).
+//Decompressors report HONK_ERROR_BAD_FORMAT if the input ends too early.
+HONK_API int64_t honk_stream_finish(honk_stream_t* stream, void* out, size_t out_capacity);
+
+//A token as the iterator below yields it, without expanding it:
+typedef struct __honk_token_view_t__
+{
+	//A run repeats byte count times, a literal is the count bytes at bytes (which point into the compressed input):
+	bool is_run;
+	uint8_t byte;
+	const uint8_t* bytes;
+	uint64_t count;
+} honk_token_view_t;
+
+//Walks the tokens of a legacy stream or a v2 container in memory (stored chunks of a container are yielded as literals).
+//Empty tokens are skipped, so a consumer can work on runs and literals directly instead of on the decoded bytes.
+typedef struct __honk_token_iterator_t__
+{
+	const uint8_t* input;
+	size_t input_count;
+	size_t pos;
+
+	//The tokens of the current chunk end at chunk_end (the end of the input for a legacy stream):
+	size_t chunk_end;
+	uint64_t chunk_size;
+	uint64_t chunk_count;
+
+	//The container (if is_framed is set) and what has been yielded from it:
+	bool is_framed;
+	bool is_wide;
+	bool is_at_end;
+	uint64_t total_size;
+	uint64_t total_count;
+
+	//HONK_ERROR_BAD_FORMAT once the input turned out to be broken (0 before):
+	int64_t error;
+} honk_token_iterator_t;
+
+//Start at the first token of src_count bytes at src (which must stay in place while the tokens are used):
+HONK_API void honk_token_iterator_init(honk_token_iterator_t* iterator, const void* src, size_t src_count);
+
+//Get the next token. Returns 1 if there is one, 0 at the end of the input or HONK_ERROR_BAD_FORMAT.
+HONK_API int64_t honk_token_iterator_next(honk_token_iterator_t* iterator, honk_token_view_t* token);
+
+//Random access to the uncompressed bytes of an indexed .honk file (a v2 container or a legacy stream with a sidecar index).
+//Every read decodes only the chunks it touches. Decoded chunks are kept in a bounded LRU cache,
+//and on sequential access the next chunk is decoded ahead by a background thread.
+//A reader may be used from several threads at once.
+typedef struct __honk_reader_t__ honk_reader_t;
+
+//Default number of decoded chunks a reader keeps:
+#define HONK_READER_DEFAULT_CACHE_SIZE 8
+
+//What a reader has done so far (e.g. to tune the cache size):
+typedef struct __honk_reader_stats_t__
+{
+	//Chunks that reads found in the cache, and chunks they had to decode:
+	uint64_t hits;
+	uint64_t loads;
+
+	//Chunks that were decoded ahead:
+	uint64_t prefetches;
+} honk_reader_stats_t;
+
+//Open an indexed .honk file. cache_size is the number of decoded chunks to keep (at least 2).
+//Legacy streams are indexed by a sidecar with the same path plus ".idx" (see honkpack --build-index).
+//Returns NULL (with errno set) if the file cannot be opened or has no chunk index.
+HONK_API honk_reader_t* honk_reader_open(const char* path, size_t cache_size);
+
+//Same as honk_reader_open(), but on a file descriptor whose container starts at the given offset.
+//The file descriptor is not closed by the reader.
+HONK_API honk_reader_t* honk_reader_open_fd(int fd, uint64_t container_offset, size_t cache_size);
+
+//Same as honk_reader_open_fd(), but for a legacy stream with a sidecar index. The sidecar is only read while opening.
+HONK_API honk_reader_t* honk_reader_open_sidecar(int fd, int sidecar_fd, uint64_t container_offset, size_t cache_size);
+
+//Close a reader:
+HONK_API void honk_reader_close(honk_reader_t* reader);
+
+//Get the uncompressed size of the file:
+HONK_API uint64_t honk_reader_size(const honk_reader_t* reader);
+
+//Read up to count uncompressed bytes at the given offset.
+//Returns the number of read bytes (less than count only at the end of the file) or -1 (with errno set) on errors.
+HONK_API ssize_t honk_reader_pread(honk_reader_t* reader, void* dst, size_t count, uint64_t offset);
+
+//Get the statistics of a reader:
+HONK_API void honk_reader_get_stats(honk_reader_t* reader, honk_reader_stats_t* stats);
+
+//Describe an error:
+HONK_API const char* honk_error_message(int64_t error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
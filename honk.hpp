@@ -0,0 +1,534 @@
+#ifndef __HONK_HPP__
+#define __HONK_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+#if __cplusplus >= 202002L
+#include <array>
+#include <bit>
+#include <iterator>
+#include <ranges>
+#endif
+
+//Only token_view needs libhonk, the rest takes just the error codes:
+#include "honk.h"
+
+//From C++20 on, the codec runs at compile time as well:
+#if __cplusplus >= 202002L
+#define HONK_CONSTEXPR constexpr
+#else
+#define HONK_CONSTEXPR
+#endif
+
+namespace honk
+{
+	//The RLE/BLOCK codec of honk_codec.c for runs of equal symbols instead of equal bytes (e.g. 16 bit samples, 24 bit or RGBA pixels).
+	//The symbol type and the longest token are compile-time parameters, so every codec gets its own inner loops.
+	//
+	//Tokens count symbols. Up to 127 of them take a status byte, more take a little endian status word (as in HONK_LAYOUT_WIDE).
+	//A run carries its symbol once, a block carries all of its symbols, both in the byte order of the machine.
+	//codec<uint8_t> writes the streams of HONK_LAYOUT_COMPAT, codec<uint8_t, 0x7FFF> the tokens of HONK_LAYOUT_WIDE.
+	template <typename Symbol, std::size_t MaxCount = 127>
+	class codec
+	{
+	public:
+		static_assert(std::is_trivially_copyable<Symbol>::value, "Symbols are compared and copied as bytes.");
+		static_assert((MaxCount >= 2) && (MaxCount <= 0x7FFF), "A token holds between 2 and 0x7FFF symbols.");
+
+		static constexpr std::size_t symbol_size = sizeof(Symbol);
+		static constexpr std::size_t max_count = MaxCount;
+		static constexpr bool is_wide = (MaxCount > 127);
+		static constexpr std::size_t header_size = is_wide ? 2 : 1;
+
+		//Largest compressed size of count symbols.
+		//The worst case are single symbols between runs of two, which take two tokens for every three symbols.
+		static constexpr std::size_t compress_bound(std::size_t count)
+		{
+			return count * symbol_size + (count / 3 * 2 + 2) * header_size;
+		}
+
+		//Compress count symbols into dst. Returns the compressed size or HONK_ERROR_DST_TOO_SMALL.
+		static std::int64_t compress(const Symbol* src, std::size_t count, void* dst, std::size_t capacity)
+		{
+			return compress(src, count, static_cast<std::uint8_t*>(dst), capacity);
+		}
+
+		static HONK_CONSTEXPR std::int64_t compress(const Symbol* src, std::size_t count, std::uint8_t* output, std::size_t capacity)
+		{
+			std::size_t output_count = 0;
+
+			//The RLE/BLOCK state machine of honk_encoder_update(), which scans for the end of each run or block.
+			//The whole input is at hand, so a block is just where it begins.
+			bool is_rle = false;
+			std::size_t token_count = 0;
+			std::size_t block_begin = 0;
+			std::size_t i = 0;
+
+			while (i < count)
+			{
+				//A token must not overflow:
+				std::size_t limit = i + (MaxCount - token_count);
+				limit = (limit < count) ? limit : count;
+
+				if (is_rle)
+				{
+					//The run extends up to the first symbol that differs from its predecessor:
+					std::size_t end = scan_boundary(src, i, limit, false);
+
+					token_count += end - i;
+					i = end;
+
+					//Is the RLE full? Then we move to the (empty) block state.
+					if (token_count == MaxCount)
+					{
+						if (!write_run(output, capacity, &output_count, src[i - 1], token_count))
+						{
+							return HONK_ERROR_DST_TOO_SMALL;
+						}
+
+						is_rle = false;
+						token_count = 0;
+					}
+					else if (i < count)
+					{
+						//We see another symbol, so the RLE must be closed and we move to the block state:
+						if (!write_run(output, capacity, &output_count, src[i - 1], token_count))
+						{
+							return HONK_ERROR_DST_TOO_SMALL;
+						}
+
+						is_rle = false;
+						token_count = 1;
+						block_begin = i;
+						i++;
+					}
+				}
+				else
+				{
+					//The block extends up to the first symbol that equals its predecessor.
+					//The first symbol of an empty block can never close it.
+					std::size_t end = scan_boundary(src, (token_count == 0) ? (i + 1) : i, limit, true);
+
+					if (token_count == 0)
+					{
+						block_begin = i;
+					}
+
+					token_count += end - i;
+					i = end;
+
+					//Is the block full?
+					if (token_count == MaxCount)
+					{
+						if (!write_block(output, capacity, &output_count, src + block_begin, token_count))
+						{
+							return HONK_ERROR_DST_TOO_SMALL;
+						}
+
+						token_count = 0;
+					}
+					else if (i < count)
+					{
+						//We see the same symbol twice, so the block must be closed (without its last symbol) and we move to RLE:
+						if ((token_count > 1) && !write_block(output, capacity, &output_count, src + block_begin, token_count - 1))
+						{
+							return HONK_ERROR_DST_TOO_SMALL;
+						}
+
+						is_rle = true;
+						token_count = 2;
+						i++;
+					}
+				}
+			}
+
+			//Write the pending run or block:
+			if (is_rle)
+			{
+				if (!write_run(output, capacity, &output_count, src[count - 1], token_count))
+				{
+					return HONK_ERROR_DST_TOO_SMALL;
+				}
+			}
+			else if ((token_count > 0) && !write_block(output, capacity, &output_count, src + block_begin, token_count))
+			{
+				return HONK_ERROR_DST_TOO_SMALL;
+			}
+
+			return static_cast<std::int64_t>(output_count);
+		}
+
+		//Decompress size bytes of tokens into dst. Returns the number of symbols, HONK_ERROR_DST_TOO_SMALL or HONK_ERROR_BAD_FORMAT.
+		//Status bytes of 0x00 and 0x80 (the escapes of HONK_LAYOUT_LONG) are not supported.
+		static std::int64_t decompress(const void* src, std::size_t size, Symbol* dst, std::size_t capacity)
+		{
+			return decompress(static_cast<const std::uint8_t*>(src), size, dst, capacity);
+		}
+
+		static HONK_CONSTEXPR std::int64_t decompress(const std::uint8_t* input, std::size_t size, Symbol* dst, std::size_t capacity)
+		{
+			std::size_t i = 0;
+			std::size_t output_count = 0;
+
+			while (i < size)
+			{
+				if (size - i < header_size)
+				{
+					return HONK_ERROR_BAD_FORMAT;
+				}
+
+				//Read the status byte or word:
+				bool is_rle;
+				std::size_t count;
+
+				if (is_wide)
+				{
+					std::uint16_t status_word = static_cast<std::uint16_t>(input[i] | (input[i + 1] << 8));
+
+					is_rle = (status_word & (1 << 15)) != 0;
+					count = status_word & 0x7FFF;
+				}
+				else
+				{
+					is_rle = (input[i] & (1 << 7)) != 0;
+					count = input[i] & 0x7F;
+
+					if (count == 0)
+					{
+						return HONK_ERROR_BAD_FORMAT;
+					}
+				}
+
+				i += header_size;
+
+				//A run carries one symbol, a block carries all of them:
+				std::size_t content_size = (is_rle ? 1 : count) * symbol_size;
+
+				if (size - i < content_size)
+				{
+					return HONK_ERROR_BAD_FORMAT;
+				}
+
+				if (capacity - output_count < count)
+				{
+					return HONK_ERROR_DST_TOO_SMALL;
+				}
+
+				if (is_rle)
+				{
+					Symbol symbol{};
+
+					load_symbols(&symbol, input + i, 1);
+					std::fill_n(dst + output_count, count, symbol);
+				}
+				else
+				{
+					load_symbols(dst + output_count, input + i, count);
+				}
+
+				i += content_size;
+				output_count += count;
+			}
+
+			return static_cast<std::int64_t>(output_count);
+		}
+
+	private:
+		//Symbols are equal if their bytes are (the size is known, so this is a plain comparison):
+		static HONK_CONSTEXPR bool is_equal(const Symbol& a, const Symbol& b)
+		{
+#if __cplusplus >= 202002L
+			if (std::is_constant_evaluated())
+			{
+				return std::bit_cast<std::array<std::uint8_t, symbol_size>>(a) == std::bit_cast<std::array<std::uint8_t, symbol_size>>(b);
+			}
+#endif
+
+			return std::memcmp(&a, &b, symbol_size) == 0;
+		}
+
+		//Copy the bytes of symbols into tokens and back (memcpy() is not available at compile time):
+		static HONK_CONSTEXPR void store_symbols(std::uint8_t* dst, const Symbol* symbols, std::size_t count)
+		{
+#if __cplusplus >= 202002L
+			if (std::is_constant_evaluated())
+			{
+				for (std::size_t i = 0; i < count; i++)
+				{
+					std::array<std::uint8_t, symbol_size> bytes = std::bit_cast<std::array<std::uint8_t, symbol_size>>(symbols[i]);
+					std::copy(bytes.begin(), bytes.end(), dst + i * symbol_size);
+				}
+
+				return;
+			}
+#endif
+
+			std::memcpy(dst, symbols, count * symbol_size);
+		}
+
+		static HONK_CONSTEXPR void load_symbols(Symbol* symbols, const std::uint8_t* src, std::size_t count)
+		{
+#if __cplusplus >= 202002L
+			if (std::is_constant_evaluated())
+			{
+				for (std::size_t i = 0; i < count; i++)
+				{
+					std::array<std::uint8_t, symbol_size> bytes{};
+					std::copy(src + i * symbol_size, src + (i + 1) * symbol_size, bytes.begin());
+					symbols[i] = std::bit_cast<Symbol>(bytes);
+				}
+
+				return;
+			}
+#endif
+
+			std::memcpy(symbols, src, count * symbol_size);
+		}
+
+		//Find the first symbol in [begin, end) that equals its predecessor (or differs from it), or end:
+		static HONK_CONSTEXPR std::size_t scan_boundary(const Symbol* symbols, std::size_t begin, std::size_t end, bool want_equal)
+		{
+			std::size_t i = begin;
+
+			while ((i < end) && (is_equal(symbols[i], symbols[i - 1]) != want_equal))
+			{
+				i++;
+			}
+
+			return i;
+		}
+
+		static HONK_CONSTEXPR void write_header(std::uint8_t* dst, bool is_rle, std::size_t count)
+		{
+			if (is_wide)
+			{
+				dst[0] = static_cast<std::uint8_t>(count);
+				dst[1] = static_cast<std::uint8_t>((count >> 8) | (is_rle ? (1 << 7) : 0));
+			}
+			else
+			{
+				dst[0] = static_cast<std::uint8_t>(count | (is_rle ? (1 << 7) : 0));
+			}
+		}
+
+		static HONK_CONSTEXPR bool write_run(std::uint8_t* dst, std::size_t capacity, std::size_t* count, const Symbol& symbol, std::size_t symbols_count)
+		{
+			if (capacity - *count < header_size + symbol_size)
+			{
+				return false;
+			}
+
+			write_header(dst + *count, true, symbols_count);
+			store_symbols(dst + *count + header_size, &symbol, 1);
+			*count += header_size + symbol_size;
+
+			return true;
+		}
+
+		static HONK_CONSTEXPR bool write_block(std::uint8_t* dst, std::size_t capacity, std::size_t* count, const Symbol* symbols, std::size_t symbols_count)
+		{
+			if (capacity - *count < header_size + symbols_count * symbol_size)
+			{
+				return false;
+			}
+
+			write_header(dst + *count, false, symbols_count);
+			store_symbols(dst + *count + header_size, symbols, symbols_count);
+			*count += header_size + symbols_count * symbol_size;
+
+			return true;
+		}
+	};
+
+	//An asset that is decoded into a buffer of Size bytes on first access (thread-safe).
+	//The buffer is passed in, so it can be a zero-initialized array that takes no space in the binary.
+	//A constant asset needs no dynamic initialization, so it can be accessed from anywhere.
+	//The tokens must not contain escapes, as written by codec<uint8_t> and by honkpack --emit-header.
+	template <std::size_t Size>
+	class lazy_asset
+	{
+	public:
+		constexpr lazy_asset(const std::uint8_t* packed, std::size_t packed_size, std::uint8_t* buffer) :
+			packed_(packed), packed_size_(packed_size), buffer_(buffer), is_valid_(false), once_()
+		{
+		}
+
+		//Get the decoded bytes (nullptr if the tokens do not decode to Size bytes):
+		const std::uint8_t* data()
+		{
+			std::call_once(once_, [this]()
+			{
+				is_valid_ = (codec<std::uint8_t>::decompress(packed_, packed_size_, buffer_, Size) == static_cast<std::int64_t>(Size));
+			});
+
+			return is_valid_ ? buffer_ : nullptr;
+		}
+
+		static constexpr std::size_t size()
+		{
+			return Size;
+		}
+
+	private:
+		const std::uint8_t* packed_;
+		std::size_t packed_size_;
+		std::uint8_t* buffer_;
+		bool is_valid_;
+		std::once_flag once_;
+	};
+
+#if __cplusplus >= 202002L
+	//Not constexpr, so an asset that is packed with the wrong size fails to compile:
+	inline void wrong_packed_size()
+	{
+	}
+
+	//Compress an asset at compile time, in two steps (the size of the result must be known first):
+	//
+	//  constexpr std::array<std::uint8_t, 4096> raw = { ... };
+	//  constexpr auto packed = honk::pack<honk::packed_size(raw)>(raw);
+	//  inline std::uint8_t buffer[raw.size()];
+	//  inline honk::lazy_asset<raw.size()> asset(packed.data(), packed.size(), buffer);
+	template <std::size_t Count>
+	constexpr std::size_t packed_size(const std::array<std::uint8_t, Count>& bytes)
+	{
+		std::array<std::uint8_t, codec<std::uint8_t>::compress_bound(Count)> packed{};
+		return static_cast<std::size_t>(codec<std::uint8_t>::compress(bytes.data(), Count, packed.data(), packed.size()));
+	}
+
+	template <std::size_t PackedSize, std::size_t Count>
+	constexpr std::array<std::uint8_t, PackedSize> pack(const std::array<std::uint8_t, Count>& bytes)
+	{
+		std::array<std::uint8_t, PackedSize> packed{};
+
+		if (codec<std::uint8_t>::compress(bytes.data(), Count, packed.data(), packed.size()) != static_cast<std::int64_t>(PackedSize))
+		{
+			wrong_packed_size();
+		}
+
+		return packed;
+	}
+
+	//The tokens of a compressed buffer as a range over honk_token_iterator_next(), without decompressing them:
+	//
+	//  honk::token_view tokens(packed, packed_size);
+	//
+	//  for (const honk_token_view_t& token : tokens)
+	//  {
+	//      token.is_run ? fill(token.byte, token.count) : copy(token.bytes, token.count);
+	//  }
+	//
+	//Every iterator walks the tokens on its own, so the view can be iterated (and copied) as often as needed.
+	//The loop ends early at broken input, which error() tells afterwards.
+	class token_view : public std::ranges::view_interface<token_view>
+	{
+	public:
+		class iterator
+		{
+		public:
+			using value_type = honk_token_view_t;
+			using difference_type = std::ptrdiff_t;
+
+			iterator() = default;
+
+			iterator(const void* src, std::size_t src_count)
+			{
+				honk_token_iterator_init(&iterator_, src, src_count);
+				advance();
+			}
+
+			//The tokens are handed out by value, as they belong to the iterator:
+			honk_token_view_t operator*() const
+			{
+				return token_;
+			}
+
+			const honk_token_view_t* operator->() const
+			{
+				return &token_;
+			}
+
+			iterator& operator++()
+			{
+				advance();
+				return *this;
+			}
+
+			iterator operator++(int)
+			{
+				iterator previous = *this;
+				advance();
+
+				return previous;
+			}
+
+			//HONK_ERROR_BAD_FORMAT if the iterator stopped at broken input, 0 otherwise:
+			std::int64_t error() const
+			{
+				return iterator_.error;
+			}
+
+			//Every token takes up input, so iterators over the same input are at the same token if they are at the same position:
+			friend bool operator==(const iterator& left, const iterator& right)
+			{
+				return (left.is_done_ == right.is_done_) && (left.is_done_ || (left.iterator_.pos == right.iterator_.pos));
+			}
+
+			friend bool operator==(const iterator& it, std::default_sentinel_t)
+			{
+				return it.is_done_;
+			}
+
+		private:
+			void advance()
+			{
+				is_done_ = (honk_token_iterator_next(&iterator_, &token_) != 1);
+			}
+
+			honk_token_iterator_t iterator_ = {};
+			honk_token_view_t token_ = {};
+			bool is_done_ = true;
+		};
+
+		token_view() = default;
+
+		token_view(const void* src, std::size_t src_count) : src_(src), src_count_(src_count)
+		{
+		}
+
+		iterator begin() const
+		{
+			return iterator(src_, src_count_);
+		}
+
+		std::default_sentinel_t end() const
+		{
+			return std::default_sentinel;
+		}
+
+		//HONK_ERROR_BAD_FORMAT if the tokens stop at broken input, 0 otherwise (walks all of them):
+		std::int64_t error() const
+		{
+			iterator it = begin();
+
+			while (it != end())
+			{
+				++it;
+			}
+
+			return it.error();
+		}
+
+	private:
+		const void* src_ = nullptr;
+		std::size_t src_count_ = 0;
+	};
+#endif
+}
+
+#endif
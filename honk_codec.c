@@ -0,0 +1,591 @@
+#include "honk_codec.h"
+
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//Width of the vectors used by the boundary scanner and the token decoder:
+#if defined(__AVX2__)
+#define VECTOR_WIDTH 32
+#elif defined(__SSE2__)
+#define VECTOR_WIDTH 16
+#endif
+
+//Build a status byte:
+static uint8_t make_status_byte(bool is_rle, size_t bytes_count);
+
+//Write the length of an escape and return its size:
+static size_t make_length(uint8_t* dst, size_t length);
+
+//Build a RLE run (status byte + content byte, or an escape for long runs, or status word + content byte) and return its size:
+static size_t make_rle_run(uint8_t* dst, honk_layout_t layout, uint8_t byte, size_t count);
+
+//Write a RLE run:
+static void write_rle_run(honk_output_t* output, honk_layout_t layout, uint8_t byte, size_t count);
+
+//Write a block (status byte + block bytes, or an escape if that is shorter than splitting the block, or status word + block bytes):
+static void write_block(honk_output_t* output, honk_layout_t layout, const uint8_t* block, size_t count);
+
+//Get the bytes of the pending block (staged in the encoder or still in the mapped input):
+static const uint8_t* get_block_bytes(const honk_encoder_t* encoder);
+
+//Find the first index in [begin, end) whose byte equals (or differs from) its predecessor.
+//Returns end if there is none. bytes[begin - 1] must be readable.
+static size_t scan_boundary(const uint8_t* bytes, size_t begin, size_t end, bool want_equal);
+
+//Is this a RLE token of zeros?
+static bool is_zero_run(const uint8_t* input, const honk_token_t* token);
+
+//Fill TOKEN_SLACK bytes at dst with the given byte:
+static void fill_token_bytes(uint8_t* dst, uint8_t byte);
+
+//Copy TOKEN_SLACK bytes from src to dst:
+static void copy_token_bytes(uint8_t* dst, const uint8_t* src);
+
+//The body of honk_decode_tokens(). It is inlined for either layout, so each one gets a loop of its own:
+static inline size_t decode_tokens(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide);
+
+static uint8_t make_status_byte(bool is_rle, size_t bytes_count)
+{
+	uint8_t status_byte = (uint8_t)bytes_count;
+
+	if (is_rle)
+	{
+		status_byte |= (1 << 7);
+	}
+
+	return status_byte;
+}
+
+static size_t make_length(uint8_t* dst, size_t length)
+{
+	size_t size = 0;
+
+	while (length >= (1 << 7))
+	{
+		dst[size++] = (uint8_t)(length | (1 << 7));
+		length >>= 7;
+	}
+
+	dst[size++] = (uint8_t)length;
+	return size;
+}
+
+static size_t make_rle_run(uint8_t* dst, honk_layout_t layout, uint8_t byte, size_t count)
+{
+	if (layout == HONK_LAYOUT_WIDE)
+	{
+		dst[0] = (uint8_t)count;
+		dst[1] = (uint8_t)(count >> 8) | (1 << 7);
+		dst[2] = byte;
+
+		return 3;
+	}
+
+	//Write the status byte (and the length of an escape) and the RLE content once:
+	if (count <= MAX_BLOCK_SIZE)
+	{
+		dst[0] = make_status_byte(true, count);
+		dst[1] = byte;
+
+		return 2;
+	}
+
+	dst[0] = make_status_byte(true, 0);
+	size_t size = 1 + make_length(dst + 1, count);
+	dst[size] = byte;
+
+	return size + 1;
+}
+
+static void write_rle_run(honk_output_t* output, honk_layout_t layout, uint8_t byte, size_t count)
+{
+	uint8_t* dst = honk_output_reserve(output, HONK_MAX_TOKEN_HEADER_SIZE + 1);
+	honk_output_commit(output, make_rle_run(dst, layout, byte, count));
+}
+
+static void write_block(honk_output_t* output, honk_layout_t layout, const uint8_t* block, size_t count)
+{
+	//An escape costs a status byte and (at least) two length bytes.
+	//Up to three full blocks are just as short (and can be read by any decoder):
+	if ((layout == HONK_LAYOUT_LONG) && (count > MAX_BLOCK_SIZE) && (count <= 3 * MAX_BLOCK_SIZE))
+	{
+		write_block(output, layout, block, MAX_BLOCK_SIZE);
+		write_block(output, layout, block + MAX_BLOCK_SIZE, count - MAX_BLOCK_SIZE);
+
+		return;
+	}
+
+	uint8_t* dst = honk_output_reserve(output, HONK_MAX_TOKEN_HEADER_SIZE + count);
+	size_t size = 1;
+
+	//Write the status byte (and the length of an escape) or the status word and the block bytes:
+	if (layout == HONK_LAYOUT_WIDE)
+	{
+		dst[0] = (uint8_t)count;
+		dst[1] = (uint8_t)(count >> 8);
+		size = 2;
+	}
+	else if (count <= MAX_BLOCK_SIZE)
+	{
+		dst[0] = make_status_byte(false, count);
+	}
+	else
+	{
+		dst[0] = make_status_byte(false, 0);
+		size += make_length(dst + 1, count);
+	}
+
+	memcpy(dst + size, block, count);
+
+	honk_output_commit(output, size + count);
+}
+
+static const uint8_t* get_block_bytes(const honk_encoder_t* encoder)
+{
+	return encoder->is_mapped ? encoder->block_bytes : encoder->block;
+}
+
+static size_t scan_boundary(const uint8_t* bytes, size_t begin, size_t end, bool want_equal)
+{
+	size_t i = begin;
+
+#ifdef VECTOR_WIDTH
+	//Compare the bytes against themselves shifted by one and build a bitmask of the boundaries:
+	for (; i + VECTOR_WIDTH <= end; i += VECTOR_WIDTH)
+	{
+#if defined(__AVX2__)
+		__m256i current = _mm256_loadu_si256((const __m256i*)(bytes + i));
+		__m256i previous = _mm256_loadu_si256((const __m256i*)(bytes + i - 1));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(current, previous));
+#else
+		__m128i current = _mm_loadu_si128((const __m128i*)(bytes + i));
+		__m128i previous = _mm_loadu_si128((const __m128i*)(bytes + i - 1));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(current, previous));
+#endif
+
+		if (!want_equal)
+		{
+			mask = ~mask & (uint32_t)(((uint64_t)1 << VECTOR_WIDTH) - 1);
+		}
+
+		if (mask != 0)
+		{
+			return i + (size_t)__builtin_ctz(mask);
+		}
+	}
+#endif
+
+	//Scalar tail:
+	for (; i < end; i++)
+	{
+		if ((bytes[i] == bytes[i - 1]) == want_equal)
+		{
+			return i;
+		}
+	}
+
+	return end;
+}
+
+static bool is_zero_run(const uint8_t* input, const honk_token_t* token)
+{
+	return token->is_rle && (input[token->content_offset] == 0);
+}
+
+static void fill_token_bytes(uint8_t* dst, uint8_t byte)
+{
+#ifdef VECTOR_WIDTH
+#if defined(__AVX2__)
+	__m256i vector = _mm256_set1_epi8((char)byte);
+
+	for (size_t i = 0; i < TOKEN_SLACK; i += VECTOR_WIDTH)
+	{
+		_mm256_storeu_si256((__m256i*)(dst + i), vector);
+	}
+#else
+	__m128i vector = _mm_set1_epi8((char)byte);
+
+	for (size_t i = 0; i < TOKEN_SLACK; i += VECTOR_WIDTH)
+	{
+		_mm_storeu_si128((__m128i*)(dst + i), vector);
+	}
+#endif
+#else
+	memset(dst, byte, TOKEN_SLACK);
+#endif
+}
+
+static void copy_token_bytes(uint8_t* dst, const uint8_t* src)
+{
+#ifdef VECTOR_WIDTH
+	for (size_t i = 0; i < TOKEN_SLACK; i += VECTOR_WIDTH)
+	{
+#if defined(__AVX2__)
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+#else
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+#endif
+	}
+#else
+	memcpy(dst, src, TOKEN_SLACK);
+#endif
+}
+
+void honk_encoder_init(honk_encoder_t* encoder, honk_layout_t layout)
+{
+	encoder->state = HONK_COMPRESS_STATE_BLOCK;
+	encoder->count = 0;
+	encoder->last_byte = 0;
+	encoder->layout = layout;
+
+	switch (layout)
+	{
+	case HONK_LAYOUT_COMPAT:
+
+		encoder->max_run_count = MAX_BLOCK_SIZE;
+		encoder->max_block_count = MAX_BLOCK_SIZE;
+		break;
+
+	case HONK_LAYOUT_LONG:
+
+		encoder->max_run_count = HONK_MAX_LONG_RUN;
+		encoder->max_block_count = HONK_MAX_LONG_BLOCK;
+		break;
+
+	case HONK_LAYOUT_WIDE:
+
+		encoder->max_run_count = HONK_MAX_WIDE_COUNT;
+		encoder->max_block_count = HONK_MAX_WIDE_COUNT;
+		break;
+	}
+
+	encoder->is_mapped = false;
+	encoder->block_bytes = NULL;
+}
+
+void honk_encoder_init_mapped(honk_encoder_t* encoder, honk_layout_t layout)
+{
+	honk_encoder_init(encoder, layout);
+	encoder->is_mapped = true;
+}
+
+void honk_encoder_update(honk_encoder_t* encoder, const uint8_t* bytes, size_t count, honk_output_t* output)
+{
+	//Process the bytes token-wise:
+	size_t i = 0;
+
+	while (i < count)
+	{
+		switch (encoder->state)
+		{
+		case HONK_COMPRESS_STATE_RLE:
+		{
+			//The run extends up to the first byte that differs from its predecessor, but it must not overflow:
+			size_t limit = i + (encoder->max_run_count - encoder->count);
+			size_t end = scan_boundary(bytes, i, (limit < count) ? limit : count, false);
+
+			encoder->count += end - i;
+			i = end;
+
+			//Is the RLE full?
+			if (encoder->count == encoder->max_run_count)
+			{
+				//Write run:
+				write_rle_run(output, encoder->layout, encoder->last_byte, encoder->max_run_count);
+
+				//Move to the (empty) block state:
+				encoder->count = 0;
+				encoder->state = HONK_COMPRESS_STATE_BLOCK;
+			}
+			else if (i < count)
+			{
+				//We see another byte, so the RLE must be closed and we move to the block state.
+				//Write run:
+				write_rle_run(output, encoder->layout, encoder->last_byte, encoder->count);
+
+				//Change state:
+				encoder->last_byte = bytes[i];
+				encoder->block[0] = bytes[i];
+				encoder->block_bytes = bytes + i;
+				encoder->count = 1;
+				encoder->state = HONK_COMPRESS_STATE_BLOCK;
+				i++;
+			}
+
+			break;
+		}
+
+		case HONK_COMPRESS_STATE_BLOCK:
+		{
+			//The block extends up to the first byte that equals its predecessor, but it must not overflow.
+			//The first byte of an empty block can never close it.
+			size_t limit = i + (encoder->max_block_count - encoder->count);
+			size_t end = scan_boundary(bytes, (encoder->count == 0) ? (i + 1) : i, (limit < count) ? limit : count, true);
+
+			//Add the new bytes to the block (mapped blocks just remember where they start):
+			if (end > i)
+			{
+				if (!encoder->is_mapped)
+				{
+					memcpy(encoder->block + encoder->count, bytes + i, end - i);
+				}
+				else if (encoder->count == 0)
+				{
+					encoder->block_bytes = bytes + i;
+				}
+
+				encoder->count += end - i;
+				encoder->last_byte = bytes[end - 1];
+				i = end;
+			}
+
+			//Is the block full?
+			if (encoder->count == encoder->max_block_count)
+			{
+				//Write block:
+				write_block(output, encoder->layout, get_block_bytes(encoder), encoder->max_block_count);
+
+				//Stay in the (empty) block state:
+				encoder->count = 0;
+			}
+			else if (i < count)
+			{
+				//We see the same byte twice, so the block must be closed and we move to RLE.
+				//The last byte is *not* part of the block:
+				size_t actual_bytes_count = encoder->count - 1;
+
+				//Write block:
+				if (actual_bytes_count > 0)
+				{
+					write_block(output, encoder->layout, get_block_bytes(encoder), actual_bytes_count);
+				}
+
+				//Change state:
+				encoder->count = 2;
+				encoder->state = HONK_COMPRESS_STATE_RLE;
+				i++;
+			}
+
+			break;
+		}
+		}
+	}
+}
+
+void honk_encoder_update_zeros(honk_encoder_t* encoder, const uint8_t* bytes, size_t count, honk_output_t* output)
+{
+	//Feed the zeros one by one until the encoder runs them (after two of them at the latest):
+	size_t i = 0;
+
+	while ((i < count) && !((encoder->state == HONK_COMPRESS_STATE_RLE) && (encoder->last_byte == 0)))
+	{
+		honk_encoder_update(encoder, bytes + i, 1, output);
+		i++;
+	}
+
+	//From a run of zeros, every max_run_count more zeros write a full run and end up in the same state:
+	size_t runs_count = (count - i) / encoder->max_run_count;
+	uint8_t run[HONK_MAX_TOKEN_HEADER_SIZE + 1];
+	size_t run_size = make_rle_run(run, encoder->layout, 0, encoder->max_run_count);
+
+	while (runs_count > 0)
+	{
+		//Fill the output a piece at a time:
+		size_t pieces_count = (output->capacity - output->count) / run_size;
+
+		if (pieces_count == 0)
+		{
+			honk_output_make_room(output, run_size);
+			continue;
+		}
+
+		pieces_count = (pieces_count < runs_count) ? pieces_count : runs_count;
+
+		for (size_t j = 0; j < pieces_count; j++)
+		{
+			memcpy(output->data + output->count + j * run_size, run, run_size);
+		}
+
+		honk_output_commit(output, pieces_count * run_size);
+		runs_count -= pieces_count;
+	}
+
+	//The rest goes the usual way:
+	i = count - (count - i) % encoder->max_run_count;
+	honk_encoder_update(encoder, bytes + i, count - i, output);
+}
+
+void honk_encoder_finish(honk_encoder_t* encoder, honk_output_t* output)
+{
+	//Write the last block if necessary:
+	switch (encoder->state)
+	{
+	case HONK_COMPRESS_STATE_RLE:
+
+		//Write run:
+		write_rle_run(output, encoder->layout, encoder->last_byte, encoder->count);
+		break;
+
+	case HONK_COMPRESS_STATE_BLOCK:
+
+		//Write block:
+		if (encoder->count > 0)
+		{
+			write_block(output, encoder->layout, get_block_bytes(encoder), encoder->count);
+		}
+
+		break;
+	}
+
+	//Start over:
+	bool is_mapped = encoder->is_mapped;
+
+	honk_encoder_init(encoder, encoder->layout);
+	encoder->is_mapped = is_mapped;
+}
+
+size_t honk_skip_tokens(const uint8_t* input, size_t input_count, uint64_t* skip_count, bool is_wide)
+{
+	size_t i = 0;
+	uint64_t remaining = *skip_count;
+
+	while (i < input_count)
+	{
+		honk_token_t token;
+
+		//Stop at incomplete tokens and at the token that reaches beyond the skipped bytes:
+		if (!honk_read_token(input + i, input_count - i, is_wide, &token) || (input_count - i < token.size) || (token.count > remaining))
+		{
+			break;
+		}
+
+		remaining -= token.count;
+		i += token.size;
+	}
+
+	*skip_count = remaining;
+	return i;
+}
+
+static inline size_t decode_tokens(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide)
+{
+	size_t i = 0;
+	size_t written = *output_count;
+
+	while (i < input_count)
+	{
+		//Read the status byte.
+		//A RLE token carries a single content byte, a block carries all of its bytes.
+		honk_token_t token;
+
+		//Stop at incomplete tokens and at full outputs:
+		if (!honk_read_token(input + i, input_count - i, is_wide, &token) || (input_count - i < token.size) || (output_capacity - written < token.count))
+		{
+			break;
+		}
+
+		//Store the whole token at once if there is enough room behind it.
+		//Everything behind count is overwritten by the next tokens, only the last ones near the ends are moved exactly.
+		//Escaped tokens are longer than the slack, so they are always moved exactly.
+		const uint8_t* content = input + i + token.content_offset;
+		bool has_output_slack = (output_capacity - written >= TOKEN_SLACK) && (token.count <= TOKEN_SLACK);
+
+		if (token.is_rle)
+		{
+			if (has_output_slack)
+			{
+				fill_token_bytes(output + written, content[0]);
+			}
+			else
+			{
+				memset(output + written, content[0], token.count);
+			}
+		}
+		else
+		{
+			if (has_output_slack && (input_count - i - token.content_offset >= TOKEN_SLACK))
+			{
+				copy_token_bytes(output + written, content);
+			}
+			else
+			{
+				memcpy(output + written, content, token.count);
+			}
+		}
+
+		written += token.count;
+		i += token.size;
+	}
+
+	*output_count = written;
+	return i;
+}
+
+size_t honk_decode_tokens(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide)
+{
+	return is_wide ? decode_tokens(input, input_count, output, output_capacity, output_count, true) : decode_tokens(input, input_count, output, output_capacity, output_count, false);
+}
+
+size_t honk_decode_tokens_sparse(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide)
+{
+	//Tokens in [decoded, i) are pending, they decode to [decoded_count, written):
+	size_t i = 0;
+	size_t written = *output_count;
+	size_t decoded = 0;
+	size_t decoded_count = written;
+
+	while (i < input_count)
+	{
+		honk_token_t token;
+
+		if (!honk_read_token(input + i, input_count - i, is_wide, &token) || (input_count - i < token.size) || (output_capacity - written < token.count))
+		{
+			break;
+		}
+
+		if (!is_zero_run(input + i, &token))
+		{
+			written += token.count;
+			i += token.size;
+
+			continue;
+		}
+
+		//Measure the run of zeros:
+		size_t end = i;
+		size_t zeros_count = 0;
+
+		while (end < input_count)
+		{
+			if (!honk_read_token(input + end, input_count - end, is_wide, &token) || (input_count - end < token.size) || !is_zero_run(input + end, &token) || (output_capacity - written - zeros_count < token.count))
+			{
+				break;
+			}
+
+			zeros_count += token.count;
+			end += token.size;
+		}
+
+		//Long runs are left out. The pending tokens are decoded first, with the output ending right in front of the run
+		//(so their slack writes cannot reach into it):
+		if (zeros_count >= HONK_SPARSE_MIN_RUN)
+		{
+			honk_decode_tokens(input + decoded, i - decoded, output, written, &decoded_count, is_wide);
+
+			decoded = end;
+			decoded_count = written + zeros_count;
+		}
+
+		written += zeros_count;
+		i = end;
+	}
+
+	//The pending tokens fill the output exactly up to where we have stopped:
+	honk_decode_tokens(input + decoded, i - decoded, output, written, &decoded_count, is_wide);
+
+	*output_count = written;
+	return i;
+}
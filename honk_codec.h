@@ -0,0 +1,178 @@
+#ifndef __HONK_CODEC_H__
+#define __HONK_CODEC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "honk_io.h"
+
+#define MAX_BLOCK_SIZE ((size_t)127)
+
+//The status bytes 0x80 and 0x00 (a run or block of 0 bytes) are escapes. Their count follows as a varint (7 bits per byte, low bits first).
+//Escaped runs and blocks may be this long (a token must still fit into the smallest I/O buffer):
+#define HONK_MAX_LONG_RUN ((size_t)4 << 20)
+#define HONK_MAX_LONG_BLOCK ((size_t)2048)
+
+//Wide tokens start with a little endian status word instead (bit 15 marks a run, the other bits are the count):
+#define HONK_MAX_WIDE_COUNT ((size_t)0x7FFF)
+#define HONK_MAX_WIDE_TOKEN_SIZE (2 + HONK_MAX_WIDE_COUNT)
+
+//Largest number of bytes a token decodes to, and the largest size of its status byte and length:
+#define HONK_MAX_TOKEN_COUNT HONK_MAX_LONG_RUN
+#define HONK_MAX_TOKEN_HEADER_SIZE ((size_t)5)
+
+//Runs of zeros that are at least this long are not written into zeroed outputs (see honk_decode_tokens_sparse()):
+#define HONK_SPARSE_MIN_RUN ((size_t)16 << 10)
+
+//Token bytes are moved as a full 128 byte span wherever the buffers have room for it:
+#define TOKEN_SLACK 128
+
+_Static_assert(TOKEN_SLACK <= HONK_IO_SLACK, "The I/O buffers must cover the token slack.");
+_Static_assert(HONK_MAX_TOKEN_HEADER_SIZE + HONK_MAX_LONG_BLOCK <= HONK_IO_MIN_BUFFER_SIZE, "A token must fit into an input buffer.");
+
+//The token layouts the encoder can write:
+typedef enum __honk_layout_t__
+{
+	//Status bytes that every decoder understands (long runs and blocks are split into several tokens):
+	HONK_LAYOUT_COMPAT,
+
+	//Status bytes, with escapes for long runs and blocks (opt-in, as decoders without escapes misread them):
+	HONK_LAYOUT_LONG,
+
+	//Status words (only found in v2 containers that are flagged with HONK_V2_FLAG_WIDE_TOKENS):
+	HONK_LAYOUT_WIDE
+} honk_layout_t;
+
+typedef enum __honk_compress_state_t__
+{
+	HONK_COMPRESS_STATE_RLE,
+	HONK_COMPRESS_STATE_BLOCK
+} honk_compress_state_t;
+
+//The RLE/BLOCK state machine of the encoder.
+//It can be fed piece by piece, the pending run or block is kept between the calls.
+typedef struct __honk_encoder_t__
+{
+	honk_compress_state_t state;
+	size_t count;
+	uint8_t last_byte;
+	uint8_t block[HONK_MAX_WIDE_COUNT];
+
+	//Longest run and block (longer than MAX_BLOCK_SIZE unless the layout is HONK_LAYOUT_COMPAT):
+	honk_layout_t layout;
+	size_t max_run_count;
+	size_t max_block_count;
+
+	//On mapped input, the pending block is not staged in block[], but written straight from the input:
+	bool is_mapped;
+	const uint8_t* block_bytes;
+} honk_encoder_t;
+
+//A token as found in the stream:
+typedef struct __honk_token_t__
+{
+	bool is_rle;
+
+	//Number of bytes it decodes to:
+	size_t count;
+
+	//Offset of the content (the repeated byte or the block bytes) and the size of the whole token:
+	size_t content_offset;
+	size_t size;
+} honk_token_t;
+
+//Start in the (empty) block state and write tokens of the given layout:
+void honk_encoder_init(honk_encoder_t* encoder, honk_layout_t layout);
+
+//Same as honk_encoder_init(), for input that stays in memory until the encoder is finished (e.g. a mapped file).
+//The bytes of all updates must follow each other in memory.
+void honk_encoder_init_mapped(honk_encoder_t* encoder, honk_layout_t layout);
+
+//Encode the given bytes and write all completed tokens to the output.
+//bytes[-1] must be readable (its value only matters if it is the previous byte of the stream).
+void honk_encoder_update(honk_encoder_t* encoder, const uint8_t* bytes, size_t count, honk_output_t* output);
+
+//Same as honk_encoder_update(), for bytes that are known to be zeros (e.g. a hole of a sparse file).
+//Only the first and the last few of them are read, the runs in between are written without looking at them.
+void honk_encoder_update_zeros(honk_encoder_t* encoder, const uint8_t* bytes, size_t count, honk_output_t* output);
+
+//Write the pending run or block:
+void honk_encoder_finish(honk_encoder_t* encoder, honk_output_t* output);
+
+//Read the status byte (and the length of an escape) or the status word of the token at input, given that input_count > 0 bytes are available.
+//Returns false if they are cut off or the escape is invalid. The content of the token may still be cut off.
+static inline bool honk_read_token(const uint8_t* input, size_t input_count, bool is_wide, honk_token_t* token)
+{
+	if (is_wide)
+	{
+		if (input_count < 2)
+		{
+			return false;
+		}
+
+		uint16_t status_word = (uint16_t)(input[0] | (input[1] << 8));
+
+		token->is_rle = (status_word & (1 << 15)) != 0;
+		token->count = (size_t)(status_word & 0x7FFF);
+		token->content_offset = 2;
+		token->size = 2 + (token->is_rle ? 1 : token->count);
+
+		return true;
+	}
+
+	uint8_t status_byte = input[0];
+
+	token->is_rle = (status_byte & (1 << 7)) != 0;
+	token->count = (size_t)(status_byte & 0x7F);
+	token->content_offset = 1;
+
+	if (token->count == 0)
+	{
+		for (size_t shift = 0;; shift += 7)
+		{
+			if ((token->content_offset == input_count) || (token->content_offset == HONK_MAX_TOKEN_HEADER_SIZE))
+			{
+				return false;
+			}
+
+			uint8_t length_byte = input[token->content_offset++];
+			token->count |= (size_t)(length_byte & 0x7F) << shift;
+
+			if ((length_byte & (1 << 7)) == 0)
+			{
+				break;
+			}
+		}
+
+		if (token->count > (token->is_rle ? HONK_MAX_LONG_RUN : HONK_MAX_LONG_BLOCK))
+		{
+			return false;
+		}
+	}
+
+	token->size = token->content_offset + (token->is_rle ? 1 : token->count);
+	return true;
+}
+
+//Are the bytes behind the last complete token of a legacy stream fine to end it?
+//Older decoders took a status byte of 0x00 for an empty block. Escapes start with it now, but a single one at the very end still reads as such.
+static inline bool honk_is_stream_tail(const uint8_t* input, size_t input_count, bool is_wide)
+{
+	return (input_count == 0) || (!is_wide && (input_count == 1) && (input[0] == 0x00));
+}
+
+//Hop over the complete tokens that decode to no more than skip_count bytes in total, without expanding them.
+//The tokens start with status words if is_wide is set (the same goes for the decoders below).
+//Returns the number of consumed input bytes and decreases skip_count by the number of skipped output bytes.
+size_t honk_skip_tokens(const uint8_t* input, size_t input_count, uint64_t* skip_count, bool is_wide);
+
+//Decode as many complete tokens as fit into the output and return the number of consumed input bytes.
+//Nothing outside of the two buffers is touched, so disjoint parts of an output can be decoded concurrently.
+size_t honk_decode_tokens(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide);
+
+//Same as honk_decode_tokens(), for an output that reads as zeros already (e.g. a fresh mapping of a sparse file).
+//Runs of at least HONK_SPARSE_MIN_RUN zeros are not written, so the pages they cover are never touched.
+size_t honk_decode_tokens_sparse(const uint8_t* input, size_t input_count, uint8_t* output, size_t output_capacity, size_t* output_count, bool is_wide);
+
+#endif
@@ -0,0 +1,641 @@
+#include "honk_container.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "honk_codec.h"
+#include "honk_io.h"
+
+static const uint8_t v2_magic[HONK_V2_MAGIC_SIZE] = { 0x00, 'H', 'O', 'N', 'K', 0x0D, 0x0A, 0x1A };
+static const uint8_t footer_magic[HONK_V2_MAGIC_SIZE] = { 'H', 'O', 'N', 'K', 'I', 'D', 'X', 0x00 };
+static const uint8_t sidecar_magic[HONK_V2_MAGIC_SIZE] = { 'H', 'O', 'N', 'K', 'S', 'I', 'D', 'X' };
+
+//Serialize / parse the entries of a chunk table:
+static void store_entries(uint8_t* dst, const honk_chunk_entry_t* entries, size_t count);
+static bool load_entries(honk_index_t* index, const uint8_t* src, size_t count, uint64_t first_compressed_offset, uint64_t min_frame_size);
+
+//Add a byte to the header of the token the builder is in front of, and take the token on once its header is complete:
+static void take_token_header(honk_index_builder_t* builder, uint8_t byte);
+
+static void store_entries(uint8_t* dst, const honk_chunk_entry_t* entries, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		honk_store_le64(dst + i * HONK_V2_TABLE_ENTRY_SIZE, entries[i].compressed_offset);
+		honk_store_le64(dst + i * HONK_V2_TABLE_ENTRY_SIZE + 8, entries[i].uncompressed_offset);
+	}
+}
+
+static bool load_entries(honk_index_t* index, const uint8_t* src, size_t count, uint64_t first_compressed_offset, uint64_t min_frame_size)
+{
+	uint64_t data_end = index->is_framed ? (index->table_offset - HONK_V2_CHUNK_HEADER_SIZE) : index->table_offset;
+
+	//Reserve the whole table, so loading fails instead of quitting on a lack of memory (the reader of libhonk loads tables):
+	honk_chunk_entry_t* entries = realloc(index->entries, (count + 1) * sizeof(honk_chunk_entry_t));
+
+	if (entries == NULL)
+	{
+		return false;
+	}
+
+	index->entries = entries;
+	index->entries_capacity = count + 1;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t compressed_offset = honk_load_le64(src + i * HONK_V2_TABLE_ENTRY_SIZE);
+		uint64_t uncompressed_offset = honk_load_le64(src + i * HONK_V2_TABLE_ENTRY_SIZE + 8);
+
+		//The offsets must grow and stay within the data:
+		bool is_valid = (i > 0) ? (compressed_offset >= index->entries[i - 1].compressed_offset + min_frame_size) : (compressed_offset == first_compressed_offset);
+		is_valid = is_valid && (uncompressed_offset >= ((i > 0) ? index->entries[i - 1].uncompressed_offset : 0));
+		is_valid = is_valid && (compressed_offset + min_frame_size <= data_end) && (uncompressed_offset <= index->header.total_size);
+
+		if (!is_valid)
+		{
+			return false;
+		}
+
+		honk_index_append(index, compressed_offset, uncompressed_offset);
+	}
+
+	return true;
+}
+
+static void take_token_header(honk_index_builder_t* builder, uint8_t byte)
+{
+	builder->compressed_offset++;
+
+	//An invalid escape stays in the header, so the stream ends up cut off:
+	if (builder->token_header_count == HONK_MAX_TOKEN_HEADER_SIZE)
+	{
+		return;
+	}
+
+	builder->token_header[builder->token_header_count++] = byte;
+
+	honk_token_t token;
+
+	if (honk_read_token(builder->token_header, builder->token_header_count, false, &token))
+	{
+		builder->uncompressed_offset += token.count;
+		builder->token_remaining = token.size - builder->token_header_count;
+		builder->token_header_count = 0;
+	}
+}
+
+void honk_store_le32(uint8_t* dst, uint32_t value)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		dst[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+void honk_store_le64(uint8_t* dst, uint64_t value)
+{
+	for (size_t i = 0; i < 8; i++)
+	{
+		dst[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+uint32_t honk_load_le32(const uint8_t* src)
+{
+	uint32_t value = 0;
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		value |= (uint32_t)src[i] << (8 * i);
+	}
+
+	return value;
+}
+
+uint64_t honk_load_le64(const uint8_t* src)
+{
+	uint64_t value = 0;
+
+	for (size_t i = 0; i < 8; i++)
+	{
+		value |= (uint64_t)src[i] << (8 * i);
+	}
+
+	return value;
+}
+
+bool honk_v2_has_magic(const uint8_t* src, size_t count)
+{
+	return (count >= HONK_V2_MAGIC_SIZE) && (memcmp(src, v2_magic, HONK_V2_MAGIC_SIZE) == 0);
+}
+
+void honk_v2_write_header(uint8_t* dst, const honk_v2_header_t* header)
+{
+	memcpy(dst, v2_magic, HONK_V2_MAGIC_SIZE);
+	dst[8] = header->version;
+	dst[9] = header->flags;
+	dst[10] = 0;
+	dst[11] = 0;
+	honk_store_le32(dst + 12, header->chunk_size);
+	honk_store_le64(dst + 16, header->total_size);
+}
+
+bool honk_v2_read_header(const uint8_t* src, honk_v2_header_t* header)
+{
+	if (!honk_v2_has_magic(src, HONK_V2_HEADER_SIZE))
+	{
+		return false;
+	}
+
+	header->version = src[8];
+	header->flags = src[9];
+	header->chunk_size = honk_load_le32(src + 12);
+	header->total_size = honk_load_le64(src + 16);
+
+	//Unknown flags could change the meaning of the chunks:
+	return (header->version == HONK_V2_VERSION) && ((header->flags & ~HONK_V2_FLAG_WIDE_TOKENS) == 0) && (header->chunk_size > 0) && (header->chunk_size <= HONK_V2_MAX_CHUNK_SIZE);
+}
+
+bool honk_v2_has_wide_tokens(const honk_v2_header_t* header)
+{
+	return (header->flags & HONK_V2_FLAG_WIDE_TOKENS) != 0;
+}
+
+void honk_v2_write_chunk_header(uint8_t* dst, const honk_v2_chunk_header_t* chunk_header)
+{
+	honk_store_le32(dst, chunk_header->payload_size | (chunk_header->is_stored ? HONK_V2_STORED_CHUNK : 0));
+	honk_store_le32(dst + 4, chunk_header->uncompressed_size);
+}
+
+bool honk_v2_read_chunk_header(const uint8_t* src, honk_v2_chunk_header_t* chunk_header)
+{
+	uint32_t payload_size = honk_load_le32(src);
+
+	chunk_header->payload_size = payload_size & ~HONK_V2_STORED_CHUNK;
+	chunk_header->uncompressed_size = honk_load_le32(src + 4);
+	chunk_header->is_stored = ((payload_size & HONK_V2_STORED_CHUNK) != 0);
+
+	//The top bit of the uncompressed size is reserved. A stored chunk is never empty (that would be the end of chunks).
+	if (chunk_header->is_stored)
+	{
+		return (chunk_header->payload_size > 0) && (chunk_header->payload_size == chunk_header->uncompressed_size);
+	}
+
+	return ((chunk_header->uncompressed_size >> 31) == 0);
+}
+
+void honk_index_init(honk_index_t* index, const honk_v2_header_t* header)
+{
+	index->header = *header;
+	index->entries = NULL;
+	index->entries_count = 0;
+	index->entries_capacity = 0;
+	index->table_offset = 0;
+	index->is_framed = true;
+}
+
+void honk_index_destroy(honk_index_t* index)
+{
+	free(index->entries);
+	index->entries = NULL;
+	index->entries_count = 0;
+	index->entries_capacity = 0;
+}
+
+void honk_index_append(honk_index_t* index, uint64_t compressed_offset, uint64_t uncompressed_offset)
+{
+	if (index->entries_count == index->entries_capacity)
+	{
+		size_t capacity = (index->entries_capacity > 0) ? (2 * index->entries_capacity) : 64;
+		honk_chunk_entry_t* entries = realloc(index->entries, capacity * sizeof(honk_chunk_entry_t));
+
+		if (entries == NULL)
+		{
+			fprintf(stderr, "Error while allocating chunk table.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		index->entries = entries;
+		index->entries_capacity = capacity;
+	}
+
+	index->entries[index->entries_count++] = (honk_chunk_entry_t){ compressed_offset, uncompressed_offset };
+}
+
+void honk_index_write_trailer(const honk_index_t* index, int fd)
+{
+	//End of chunks:
+	uint8_t end_of_chunks[HONK_V2_CHUNK_HEADER_SIZE] = { 0 };
+	honk_io_write_full(fd, end_of_chunks, sizeof(end_of_chunks));
+
+	//Chunk table, written in pieces of 256 entries:
+	uint8_t entries[256 * HONK_V2_TABLE_ENTRY_SIZE];
+
+	for (size_t i = 0; i < index->entries_count; i += 256)
+	{
+		size_t count = (index->entries_count - i < 256) ? (index->entries_count - i) : 256;
+
+		store_entries(entries, index->entries + i, count);
+		honk_io_write_full(fd, entries, count * HONK_V2_TABLE_ENTRY_SIZE);
+	}
+
+	//Footer:
+	uint8_t footer[HONK_V2_FOOTER_SIZE];
+
+	honk_store_le64(footer, index->table_offset);
+	honk_store_le64(footer + 8, index->entries_count);
+	honk_store_le64(footer + 16, index->header.total_size);
+	memcpy(footer + 24, footer_magic, HONK_V2_MAGIC_SIZE);
+
+	honk_io_write_full(fd, footer, sizeof(footer));
+}
+
+bool honk_index_load(honk_index_t* index, int fd, uint64_t container_offset)
+{
+	struct stat stat_buf;
+
+	if ((fstat(fd, &stat_buf) != 0) || !S_ISREG(stat_buf.st_mode))
+	{
+		return false;
+	}
+
+	uint64_t file_size = (uint64_t)stat_buf.st_size;
+
+	if (file_size < container_offset + HONK_V2_HEADER_SIZE + HONK_V2_CHUNK_HEADER_SIZE + HONK_V2_FOOTER_SIZE)
+	{
+		return false;
+	}
+
+	//Header:
+	uint8_t header_bytes[HONK_V2_HEADER_SIZE];
+	honk_v2_header_t header;
+
+	if ((honk_io_try_pread_full(fd, header_bytes, sizeof(header_bytes), container_offset) != (ssize_t)sizeof(header_bytes)) || !honk_v2_read_header(header_bytes, &header))
+	{
+		return false;
+	}
+
+	//Footer:
+	uint8_t footer[HONK_V2_FOOTER_SIZE];
+	uint64_t footer_offset = file_size - HONK_V2_FOOTER_SIZE;
+
+	if ((honk_io_try_pread_full(fd, footer, sizeof(footer), footer_offset) != (ssize_t)sizeof(footer)) || (memcmp(footer + 24, footer_magic, HONK_V2_MAGIC_SIZE) != 0))
+	{
+		return false;
+	}
+
+	uint64_t table_offset = honk_load_le64(footer);
+	uint64_t entries_count = honk_load_le64(footer + 8);
+
+	if ((table_offset < HONK_V2_HEADER_SIZE + HONK_V2_CHUNK_HEADER_SIZE) || (entries_count > (footer_offset - container_offset) / HONK_V2_TABLE_ENTRY_SIZE) || (container_offset + table_offset + entries_count * HONK_V2_TABLE_ENTRY_SIZE != footer_offset))
+	{
+		return false;
+	}
+
+	//The total size is only known for sure at the end:
+	header.total_size = honk_load_le64(footer + 16);
+
+	honk_index_init(index, &header);
+	index->table_offset = table_offset;
+
+	//Chunk table:
+	uint8_t* entries = malloc(entries_count * HONK_V2_TABLE_ENTRY_SIZE + 1);
+
+	if (entries == NULL)
+	{
+		honk_index_destroy(index);
+		return false;
+	}
+
+	//The first chunk follows the header:
+	bool is_valid = (honk_io_try_pread_full(fd, entries, entries_count * HONK_V2_TABLE_ENTRY_SIZE, container_offset + table_offset) == (ssize_t)(entries_count * HONK_V2_TABLE_ENTRY_SIZE));
+	is_valid = is_valid && load_entries(index, entries, entries_count, HONK_V2_HEADER_SIZE, HONK_V2_CHUNK_HEADER_SIZE);
+
+	free(entries);
+
+	if (!is_valid)
+	{
+		honk_index_destroy(index);
+	}
+
+	return is_valid;
+}
+
+void honk_index_builder_init(honk_index_builder_t* builder, honk_index_t* index, size_t interval)
+{
+	honk_v2_header_t header = { HONK_SIDECAR_VERSION, 0, 0, 0 };
+
+	honk_index_init(index, &header);
+	index->is_framed = false;
+
+	builder->index = index;
+	builder->interval = interval;
+	builder->compressed_offset = 0;
+	builder->uncompressed_offset = 0;
+	builder->next_checkpoint = 0;
+	builder->token_remaining = 0;
+	builder->token_header_count = 0;
+}
+
+void honk_index_builder_update(honk_index_builder_t* builder, const uint8_t* bytes, size_t count)
+{
+	size_t i = 0;
+
+	while (i < count)
+	{
+		//Skip the rest of the current token:
+		if (builder->token_remaining > 0)
+		{
+			size_t token_count = (count - i < builder->token_remaining) ? (count - i) : builder->token_remaining;
+
+			i += token_count;
+			builder->compressed_offset += token_count;
+			builder->token_remaining -= token_count;
+
+			continue;
+		}
+
+		//Collect the header of a token that is cut off:
+		if (builder->token_header_count > 0)
+		{
+			take_token_header(builder, bytes[i]);
+			i++;
+
+			continue;
+		}
+
+		//A checkpoint is due whenever the output has grown by the interval:
+		if (builder->uncompressed_offset >= builder->next_checkpoint)
+		{
+			honk_index_append(builder->index, builder->compressed_offset, builder->uncompressed_offset);
+			builder->next_checkpoint = builder->uncompressed_offset + builder->interval;
+		}
+
+		//Hop over the complete tokens in front of the next checkpoint:
+		uint64_t skip_count = builder->next_checkpoint - builder->uncompressed_offset;
+		size_t tokens_size = honk_skip_tokens(bytes + i, count - i, &skip_count, false);
+
+		i += tokens_size;
+		builder->compressed_offset += tokens_size;
+		builder->uncompressed_offset = builder->next_checkpoint - skip_count;
+
+		//The next token crosses the checkpoint or the end of the piece, so we take it on its own:
+		if ((tokens_size == 0) && (i < count))
+		{
+			take_token_header(builder, bytes[i]);
+			i++;
+		}
+	}
+}
+
+bool honk_index_builder_finish(honk_index_builder_t* builder)
+{
+	honk_index_t* index = builder->index;
+
+	index->header.total_size = builder->uncompressed_offset;
+	index->table_offset = builder->compressed_offset;
+
+	//The chunk size is the largest chunk (a bit more than the interval, because checkpoints wait for a token boundary):
+	for (size_t i = 0; i < index->entries_count; i++)
+	{
+		uint64_t size = honk_index_uncompressed_end(index, i) - index->entries[i].uncompressed_offset;
+		index->header.chunk_size = (size > index->header.chunk_size) ? (uint32_t)size : index->header.chunk_size;
+	}
+
+	//A token must not be cut off:
+	return (builder->token_remaining == 0) && honk_is_stream_tail(builder->token_header, builder->token_header_count, false);
+}
+
+bool honk_index_build_sidecar(honk_index_t* index, honk_input_t* input, size_t interval)
+{
+	honk_index_builder_t builder;
+	honk_index_builder_init(&builder, index, interval);
+
+	//The input may hold some bytes already:
+	do
+	{
+		honk_index_builder_update(&builder, input->data + input->pos, input->count - input->pos);
+		input->pos = input->count;
+	}
+	while (honk_input_refill(input) > 0);
+
+	return honk_index_builder_finish(&builder);
+}
+
+void honk_index_write_sidecar(const honk_index_t* index, int fd)
+{
+	uint8_t header[HONK_SIDECAR_HEADER_SIZE] = { 0 };
+
+	memcpy(header, sidecar_magic, HONK_V2_MAGIC_SIZE);
+	header[8] = HONK_SIDECAR_VERSION;
+	honk_store_le32(header + 12, index->header.chunk_size);
+	honk_store_le64(header + 16, index->header.total_size);
+	honk_store_le64(header + 24, index->table_offset);
+	honk_store_le64(header + 32, index->entries_count);
+
+	honk_io_write_full(fd, header, sizeof(header));
+
+	//Chunk table, written in pieces of 256 entries:
+	uint8_t entries[256 * HONK_V2_TABLE_ENTRY_SIZE];
+
+	for (size_t i = 0; i < index->entries_count; i += 256)
+	{
+		size_t count = (index->entries_count - i < 256) ? (index->entries_count - i) : 256;
+
+		store_entries(entries, index->entries + i, count);
+		honk_io_write_full(fd, entries, count * HONK_V2_TABLE_ENTRY_SIZE);
+	}
+}
+
+bool honk_index_load_sidecar(honk_index_t* index, int sidecar_fd, int fd, uint64_t container_offset)
+{
+	struct stat stat_buf;
+
+	if ((fstat(fd, &stat_buf) != 0) || !S_ISREG(stat_buf.st_mode) || ((uint64_t)stat_buf.st_size < container_offset))
+	{
+		return false;
+	}
+
+	uint64_t stream_size = (uint64_t)stat_buf.st_size - container_offset;
+
+	//Header:
+	uint8_t header_bytes[HONK_SIDECAR_HEADER_SIZE];
+
+	if ((fstat(sidecar_fd, &stat_buf) != 0) || (honk_io_try_pread_full(sidecar_fd, header_bytes, sizeof(header_bytes), 0) != (ssize_t)sizeof(header_bytes)))
+	{
+		return false;
+	}
+
+	honk_v2_header_t header = { header_bytes[8], 0, honk_load_le32(header_bytes + 12), honk_load_le64(header_bytes + 16) };
+	uint64_t entries_count = honk_load_le64(header_bytes + 32);
+
+	bool is_valid = (memcmp(header_bytes, sidecar_magic, HONK_V2_MAGIC_SIZE) == 0) && (header.version == HONK_SIDECAR_VERSION) && (header.chunk_size <= HONK_V2_MAX_CHUNK_SIZE + 2 * HONK_MAX_TOKEN_COUNT);
+	is_valid = is_valid && (honk_load_le64(header_bytes + 24) == stream_size);
+	is_valid = is_valid && (entries_count <= stream_size) && ((uint64_t)stat_buf.st_size == HONK_SIDECAR_HEADER_SIZE + entries_count * HONK_V2_TABLE_ENTRY_SIZE);
+
+	if (!is_valid)
+	{
+		return false;
+	}
+
+	honk_index_init(index, &header);
+	index->table_offset = stream_size;
+	index->is_framed = false;
+
+	//Chunk table:
+	uint8_t* entries = malloc(entries_count * HONK_V2_TABLE_ENTRY_SIZE + 1);
+
+	if (entries == NULL)
+	{
+		honk_index_destroy(index);
+		return false;
+	}
+
+	//The first chunk starts at the beginning of the stream, every chunk holds at least one token:
+	is_valid = (honk_io_try_pread_full(sidecar_fd, entries, entries_count * HONK_V2_TABLE_ENTRY_SIZE, HONK_SIDECAR_HEADER_SIZE) == (ssize_t)(entries_count * HONK_V2_TABLE_ENTRY_SIZE));
+	is_valid = is_valid && load_entries(index, entries, entries_count, 0, 1);
+
+	//The chunks must fit the chunk size:
+	for (size_t i = 0; is_valid && (i < index->entries_count); i++)
+	{
+		is_valid = (honk_index_uncompressed_end(index, i) - index->entries[i].uncompressed_offset <= header.chunk_size);
+	}
+
+	free(entries);
+
+	if (!is_valid)
+	{
+		honk_index_destroy(index);
+	}
+
+	return is_valid;
+}
+
+size_t honk_index_find(const honk_index_t* index, uint64_t offset)
+{
+	//Binary search for the last chunk that starts at or before the offset:
+	size_t begin = 0;
+	size_t end = index->entries_count;
+
+	while (end - begin > 1)
+	{
+		size_t middle = begin + (end - begin) / 2;
+
+		if (index->entries[middle].uncompressed_offset <= offset)
+		{
+			begin = middle;
+		}
+		else
+		{
+			end = middle;
+		}
+	}
+
+	return begin;
+}
+
+uint64_t honk_index_compressed_end(const honk_index_t* index, size_t chunk)
+{
+	//The last chunk ends at the end of chunks (or at the end of the stream):
+	if (chunk + 1 < index->entries_count)
+	{
+		return index->entries[chunk + 1].compressed_offset;
+	}
+
+	return index->is_framed ? (index->table_offset - HONK_V2_CHUNK_HEADER_SIZE) : index->table_offset;
+}
+
+uint64_t honk_index_uncompressed_end(const honk_index_t* index, size_t chunk)
+{
+	return (chunk + 1 < index->entries_count) ? index->entries[chunk + 1].uncompressed_offset : index->header.total_size;
+}
+
+uint64_t honk_index_max_compressed_size(const honk_index_t* index)
+{
+	uint64_t max_size = 0;
+
+	for (size_t i = 0; i < index->entries_count; i++)
+	{
+		uint64_t size = honk_index_compressed_end(index, i) - index->entries[i].compressed_offset;
+		max_size = (size > max_size) ? size : max_size;
+	}
+
+	return max_size;
+}
+
+uint64_t honk_index_max_uncompressed_size(const honk_index_t* index)
+{
+	uint64_t max_size = 0;
+
+	for (size_t i = 0; i < index->entries_count; i++)
+	{
+		uint64_t size = honk_index_uncompressed_end(index, i) - index->entries[i].uncompressed_offset;
+		max_size = (size > max_size) ? size : max_size;
+	}
+
+	return max_size;
+}
+
+bool honk_index_check_chunk_header(const honk_index_t* index, size_t chunk, const uint8_t* src, uint64_t chunk_size, honk_v2_chunk_header_t* chunk_header)
+{
+	uint64_t uncompressed_size = honk_index_uncompressed_end(index, chunk) - index->entries[chunk].uncompressed_offset;
+
+	if ((chunk_size < HONK_V2_CHUNK_HEADER_SIZE) || !honk_v2_read_chunk_header(src, chunk_header))
+	{
+		return false;
+	}
+
+	return (chunk_header->payload_size == chunk_size - HONK_V2_CHUNK_HEADER_SIZE) && (chunk_header->uncompressed_size == uncompressed_size);
+}
+
+const uint8_t* honk_index_chunk_payload(const honk_index_t* index, size_t chunk, const uint8_t* src, size_t* count, bool* is_stored)
+{
+	*is_stored = false;
+
+	if (!index->is_framed)
+	{
+		return src;
+	}
+
+	honk_v2_chunk_header_t chunk_header;
+
+	if (!honk_index_check_chunk_header(index, chunk, src, *count, &chunk_header))
+	{
+		return NULL;
+	}
+
+	*count = chunk_header.payload_size;
+	*is_stored = chunk_header.is_stored;
+
+	return src + HONK_V2_CHUNK_HEADER_SIZE;
+}
+
+bool honk_index_decode_chunk(const honk_index_t* index, size_t chunk, const uint8_t* src, size_t src_count, uint8_t* dst, bool is_zeroed)
+{
+	uint64_t uncompressed_size = honk_index_uncompressed_end(index, chunk) - index->entries[chunk].uncompressed_offset;
+	bool is_stored;
+	const uint8_t* payload = honk_index_chunk_payload(index, chunk, src, &src_count, &is_stored);
+
+	if ((payload == NULL) || (uncompressed_size > index->header.chunk_size))
+	{
+		return false;
+	}
+
+	//The header has made sure that a stored payload has the size of the chunk:
+	if (is_stored)
+	{
+		memcpy(dst, payload, src_count);
+		return true;
+	}
+
+	size_t dst_count = 0;
+	bool is_wide = honk_v2_has_wide_tokens(&index->header);
+	size_t tokens_size = is_zeroed ? honk_decode_tokens_sparse(payload, src_count, dst, (size_t)uncompressed_size, &dst_count, is_wide) : honk_decode_tokens(payload, src_count, dst, (size_t)uncompressed_size, &dst_count, is_wide);
+
+	//The last chunk of a legacy stream may end with an empty block:
+	bool is_complete = index->is_framed ? (tokens_size == src_count) : honk_is_stream_tail(payload + tokens_size, src_count - tokens_size, false);
+
+	return is_complete && (dst_count == uncompressed_size);
+}
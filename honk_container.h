@@ -0,0 +1,217 @@
+#ifndef __HONK_CONTAINER_H__
+#define __HONK_CONTAINER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "honk_codec.h"
+#include "honk_io.h"
+
+//The .honk v2 container (all numbers are little endian, offsets are relative to the start of the header):
+//
+//  Header (24 bytes):
+//    magic[8]          "\0HONK\r\n\x1A" (legacy streams never start with an empty block, so this cannot be confused with them)
+//    version (u8)      2
+//    flags (u8)        HONK_V2_FLAG_WIDE_TOKENS or 0
+//    reserved (u16)    0
+//    chunk_size (u32)  Uncompressed size of every chunk but the last one
+//    total_size (u64)  Uncompressed size of the whole file (HONK_V2_UNKNOWN_SIZE if it was not known in advance)
+//
+//  Chunks, each of them an independently decodable legacy token stream (made of wide tokens if the header is flagged so):
+//    payload_size (u32), uncompressed_size (u32), payload
+//  or a stored chunk (if the tokens would be larger than the chunk itself), whose payload is the chunk as it is:
+//    payload_size | HONK_V2_STORED_CHUNK (u32), uncompressed_size (u32) = payload_size, payload
+//  End of chunks:
+//    payload_size = 0, uncompressed_size = 0
+//
+//  Chunk table:
+//    For every chunk: compressed_offset (u64, offset of its chunk header), uncompressed_offset (u64)
+//
+//  Footer (32 bytes):
+//    table_offset (u64), chunks_count (u64), total_size (u64), magic[8] "HONKIDX\0"
+//
+//The sidecar index (.honk.idx) of a legacy stream, laid out so it can be mapped into memory as it is:
+//
+//  Header (40 bytes):
+//    magic[8]          "HONKSIDX"
+//    version (u8)      1
+//    reserved[3]       0
+//    chunk_size (u32)  Largest uncompressed size of a chunk
+//    total_size (u64)  Uncompressed size of the stream
+//    stream_size (u64) Compressed size of the stream (to detect a sidecar that does not belong to it)
+//    chunks_count (u64)
+//
+//  Chunk table (like in the container), where every chunk starts at a token boundary of the stream:
+//    For every chunk: compressed_offset (u64), uncompressed_offset (u64)
+
+#define HONK_V2_MAGIC_SIZE 8
+#define HONK_V2_VERSION 2
+#define HONK_V2_HEADER_SIZE 24
+#define HONK_V2_CHUNK_HEADER_SIZE 8
+#define HONK_V2_TABLE_ENTRY_SIZE 16
+#define HONK_V2_FOOTER_SIZE 32
+
+#define HONK_SIDECAR_VERSION 1
+#define HONK_SIDECAR_HEADER_SIZE 40
+#define HONK_SIDECAR_SUFFIX ".idx"
+
+//Marks a total size that was not known when the header was written:
+#define HONK_V2_UNKNOWN_SIZE UINT64_MAX
+
+//Marks a container whose tokens start with status words (see HONK_LAYOUT_WIDE):
+#define HONK_V2_FLAG_WIDE_TOKENS ((uint8_t)1 << 0)
+
+//Marks a stored chunk in the payload size of its chunk header:
+#define HONK_V2_STORED_CHUNK ((uint32_t)1 << 31)
+
+//Largest supported chunk size (the sizes in the chunk headers must fit 31 bits):
+#define HONK_V2_MAX_CHUNK_SIZE ((size_t)1 << 30)
+
+//Output formats of the encoder:
+typedef enum __honk_format_t__
+{
+	HONK_FORMAT_LEGACY,
+	HONK_FORMAT_V2
+} honk_format_t;
+
+typedef struct __honk_v2_header_t__
+{
+	uint8_t version;
+	uint8_t flags;
+	uint32_t chunk_size;
+	uint64_t total_size;
+} honk_v2_header_t;
+
+typedef struct __honk_v2_chunk_header_t__
+{
+	uint32_t payload_size;
+	uint32_t uncompressed_size;
+
+	//Is the payload the uncompressed chunk itself?
+	bool is_stored;
+} honk_v2_chunk_header_t;
+
+typedef struct __honk_chunk_entry_t__
+{
+	uint64_t compressed_offset;
+	uint64_t uncompressed_offset;
+} honk_chunk_entry_t;
+
+//The chunk table of a container, together with its header:
+typedef struct __honk_index_t__
+{
+	honk_v2_header_t header;
+
+	honk_chunk_entry_t* entries;
+	size_t entries_count;
+	size_t entries_capacity;
+
+	//The chunk table starts here (which is also the end of the chunk data):
+	uint64_t table_offset;
+
+	//Do the chunks carry chunk headers? The checkpoints of a sidecar index point into a plain legacy stream instead.
+	//Their table offset is the end of the stream.
+	bool is_framed;
+} honk_index_t;
+
+//Records the checkpoints of a legacy stream that is fed to it piece by piece:
+typedef struct __honk_index_builder_t__
+{
+	honk_index_t* index;
+	size_t interval;
+
+	uint64_t compressed_offset;
+	uint64_t uncompressed_offset;
+	uint64_t next_checkpoint;
+
+	//Bytes of the current token that have not been seen yet:
+	size_t token_remaining;
+
+	//The status byte and length of a token that is cut off in front of them:
+	uint8_t token_header[HONK_MAX_TOKEN_HEADER_SIZE];
+	size_t token_header_count;
+} honk_index_builder_t;
+
+//Little endian helpers:
+void honk_store_le32(uint8_t* dst, uint32_t value);
+void honk_store_le64(uint8_t* dst, uint64_t value);
+uint32_t honk_load_le32(const uint8_t* src);
+uint64_t honk_load_le64(const uint8_t* src);
+
+//Does the stream start with the v2 magic? At least HONK_V2_MAGIC_SIZE bytes are needed to tell.
+bool honk_v2_has_magic(const uint8_t* src, size_t count);
+
+//Serialize a header (HONK_V2_HEADER_SIZE bytes):
+void honk_v2_write_header(uint8_t* dst, const honk_v2_header_t* header);
+
+//Parse a header (HONK_V2_HEADER_SIZE bytes). Returns false on a bad magic or an unsupported version.
+bool honk_v2_read_header(const uint8_t* src, honk_v2_header_t* header);
+
+//Are the chunks made of wide tokens?
+bool honk_v2_has_wide_tokens(const honk_v2_header_t* header);
+
+//Serialize / parse a chunk header (HONK_V2_CHUNK_HEADER_SIZE bytes). Parsing fails on reserved bits and on a stored chunk whose sizes differ.
+void honk_v2_write_chunk_header(uint8_t* dst, const honk_v2_chunk_header_t* chunk_header);
+bool honk_v2_read_chunk_header(const uint8_t* src, honk_v2_chunk_header_t* chunk_header);
+
+//Set up an empty index:
+void honk_index_init(honk_index_t* index, const honk_v2_header_t* header);
+
+//Release the entries of an index:
+void honk_index_destroy(honk_index_t* index);
+
+//Record the next chunk:
+void honk_index_append(honk_index_t* index, uint64_t compressed_offset, uint64_t uncompressed_offset);
+
+//Write the end of chunks, the chunk table and the footer. The index must know its table offset and total size.
+void honk_index_write_trailer(const honk_index_t* index, int fd);
+
+//Load the header and the chunk table of a container that starts at the given offset of a seekable file.
+//Returns false if the file cannot be read or is not a complete v2 container.
+bool honk_index_load(honk_index_t* index, int fd, uint64_t container_offset);
+
+//Start a builder on an empty unframed index. A checkpoint is recorded at the first token boundary behind every interval bytes of output.
+void honk_index_builder_init(honk_index_builder_t* builder, honk_index_t* index, size_t interval);
+
+//Scan the next bytes of the stream (tokens may cross the borders of the pieces):
+void honk_index_builder_update(honk_index_builder_t* builder, const uint8_t* bytes, size_t count);
+
+//Complete the index. Returns false if the last token is cut off.
+bool honk_index_builder_finish(honk_index_builder_t* builder);
+
+//Scan a legacy stream and record its checkpoints. Returns false if the stream is damaged.
+bool honk_index_build_sidecar(honk_index_t* index, honk_input_t* input, size_t interval);
+
+//Write a sidecar index:
+void honk_index_write_sidecar(const honk_index_t* index, int fd);
+
+//Load a sidecar index for the legacy stream that starts at the given offset of a seekable file.
+//Returns false if the sidecar cannot be read, is damaged or does not match the size of the stream.
+bool honk_index_load_sidecar(honk_index_t* index, int sidecar_fd, int fd, uint64_t container_offset);
+
+//Find the chunk that contains the given uncompressed offset:
+size_t honk_index_find(const honk_index_t* index, uint64_t offset);
+
+//Get the compressed / uncompressed end of a chunk:
+uint64_t honk_index_compressed_end(const honk_index_t* index, size_t chunk);
+uint64_t honk_index_uncompressed_end(const honk_index_t* index, size_t chunk);
+
+//Get the largest compressed / uncompressed size of a chunk in the table (to size buffers that hold any of them):
+uint64_t honk_index_max_compressed_size(const honk_index_t* index);
+uint64_t honk_index_max_uncompressed_size(const honk_index_t* index);
+
+//Parse the chunk header of a framed chunk and check it against the table, given the size of the whole chunk (from its compressed offset to its compressed end):
+bool honk_index_check_chunk_header(const honk_index_t* index, size_t chunk, const uint8_t* src, uint64_t chunk_size, honk_v2_chunk_header_t* chunk_header);
+
+//Get the payload of a chunk, given its compressed bytes (from its compressed offset to its compressed end).
+//It is a token stream, or the uncompressed chunk itself if is_stored is set.
+//The chunk header is checked against the table. Returns NULL if it does not match.
+const uint8_t* honk_index_chunk_payload(const honk_index_t* index, size_t chunk, const uint8_t* src, size_t* count, bool* is_stored);
+
+//Decode (or copy) a chunk, given its compressed bytes (from its compressed offset to its compressed end).
+//If dst is zeroed already, long runs of zeros are left out (see honk_decode_tokens_sparse()).
+//The chunk header is checked against the table. Returns false if the chunk is damaged.
+bool honk_index_decode_chunk(const honk_index_t* index, size_t chunk, const uint8_t* src, size_t src_count, uint8_t* dst, bool is_zeroed);
+
+#endif
@@ -0,0 +1,838 @@
+//copy_file_range() is a Linux extension:
+#define _GNU_SOURCE
+
+#include "honk_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Granularity of the holes in sparse outputs (a page):
+#define SPARSE_BLOCK_SIZE ((size_t)4096)
+
+//Tell the kernel that we will not need the already consumed input again:
+static void drop_consumed_input(honk_input_t* input);
+
+//Is this a whole block of zeros?
+static bool is_zero_block(const uint8_t* bytes, size_t count);
+
+//Find the end of the span of data blocks (or of whole blocks of zeros) that starts at bytes[begin], given the file position of bytes[0]:
+static size_t find_span(const uint8_t* bytes, size_t begin, size_t count, uint64_t position, bool* is_hole);
+
+//Write the pending bytes of a sparse output, seeking over whole blocks of zeros:
+static void write_sparse(honk_output_t* output);
+
+uint8_t* honk_io_alloc_buffer(size_t capacity)
+{
+	uint8_t* storage = calloc(1 + capacity + HONK_IO_SLACK, 1);
+
+	if (storage == NULL)
+	{
+		fprintf(stderr, "Error while allocating I/O buffer.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return storage + 1;
+}
+
+void honk_io_free_buffer(uint8_t* buffer)
+{
+	if (buffer != NULL)
+	{
+		free(buffer - 1);
+	}
+}
+
+void honk_io_advise_sequential(int fd)
+{
+	//This fails silently on pipes:
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+	(void)fd;
+#endif
+}
+
+bool honk_io_is_writable_file(int fd)
+{
+	struct stat stat_buf;
+	int flags = fcntl(fd, F_GETFL);
+
+	//pwrite() ignores the offset on O_APPEND files:
+	return (fstat(fd, &stat_buf) == 0) && S_ISREG(stat_buf.st_mode) && (flags != -1) && !(flags & O_APPEND);
+}
+
+off_t honk_io_tell(int fd)
+{
+	return lseek(fd, 0, SEEK_CUR);
+}
+
+size_t honk_io_read_full(int fd, uint8_t* dst, size_t size)
+{
+	size_t count = 0;
+
+	while (count < size)
+	{
+		ssize_t bytes_count = read(fd, dst + count, size - count);
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "Error while reading from input file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (bytes_count == 0)
+		{
+			break;
+		}
+
+		count += (size_t)bytes_count;
+	}
+
+	return count;
+}
+
+void honk_io_write_full(int fd, const uint8_t* src, size_t size)
+{
+	size_t written = 0;
+
+	while (written < size)
+	{
+		ssize_t bytes_count = write(fd, src + written, size - written);
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "Error while writing to output file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		written += (size_t)bytes_count;
+	}
+}
+
+static void drop_consumed_input(honk_input_t* input)
+{
+#ifdef POSIX_FADV_DONTNEED
+	//Only drop what lies in front of the buffer, so there is no need to worry about pages we still use:
+	off_t consumed_offset = input->offset - (off_t)input->count;
+
+	if (consumed_offset > input->dropped_offset)
+	{
+		posix_fadvise(input->fd, input->dropped_offset, consumed_offset - input->dropped_offset, POSIX_FADV_DONTNEED);
+		input->dropped_offset = consumed_offset;
+	}
+#else
+	(void)input;
+#endif
+}
+
+static bool is_zero_block(const uint8_t* bytes, size_t count)
+{
+	//Every byte equals its successor and the first one is zero:
+	return (count == SPARSE_BLOCK_SIZE) && (bytes[0] == 0) && (memcmp(bytes, bytes + 1, count - 1) == 0);
+}
+
+static size_t find_span(const uint8_t* bytes, size_t begin, size_t count, uint64_t position, bool* is_hole)
+{
+	size_t end = begin;
+
+	//Cut the bytes at the block boundaries of the file and join the blocks of the same kind:
+	while (end < count)
+	{
+		size_t block_end = end + SPARSE_BLOCK_SIZE - (size_t)((position + end) % SPARSE_BLOCK_SIZE);
+		block_end = (block_end < count) ? block_end : count;
+
+		bool is_zero = is_zero_block(bytes + end, block_end - end);
+
+		if ((end > begin) && (is_zero != *is_hole))
+		{
+			break;
+		}
+
+		*is_hole = is_zero;
+		end = block_end;
+	}
+
+	return end;
+}
+
+static void write_sparse(honk_output_t* output)
+{
+	uint64_t position = (uint64_t)honk_io_tell(output->fd);
+
+	for (size_t i = 0, end; i < output->count; i = end)
+	{
+		bool is_hole = false;
+		end = find_span(output->data, i, output->count, position, &is_hole);
+
+		if (!is_hole)
+		{
+			honk_io_write_full(output->fd, output->data + i, end - i);
+		}
+		else if (lseek(output->fd, (off_t)(end - i), SEEK_CUR) < 0)
+		{
+			fprintf(stderr, "Error while writing to output file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		output->is_hole_pending = is_hole;
+	}
+}
+
+size_t honk_io_pread_full(int fd, uint8_t* dst, size_t size, uint64_t offset)
+{
+	ssize_t count = honk_io_try_pread_full(fd, dst, size, offset);
+
+	if (count < 0)
+	{
+		fprintf(stderr, "Error while reading from input file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return (size_t)count;
+}
+
+ssize_t honk_io_try_pread_full(int fd, uint8_t* dst, size_t size, uint64_t offset)
+{
+	size_t count = 0;
+
+	while (count < size)
+	{
+		ssize_t bytes_count = pread(fd, dst + count, size - count, (off_t)(offset + count));
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+
+		if (bytes_count == 0)
+		{
+			break;
+		}
+
+		count += (size_t)bytes_count;
+	}
+
+	return (ssize_t)count;
+}
+
+void honk_io_pwrite_full(int fd, const uint8_t* src, size_t size, uint64_t offset)
+{
+	size_t written = 0;
+
+	while (written < size)
+	{
+		ssize_t bytes_count = pwrite(fd, src + written, size - written, (off_t)(offset + written));
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "Error while writing to output file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		written += (size_t)bytes_count;
+	}
+}
+
+void honk_io_copy_range(int input_fd, uint64_t input_offset, int output_fd, uint64_t output_offset, uint64_t size)
+{
+#ifdef __linux__
+	while (size > 0)
+	{
+		loff_t input_pos = (loff_t)input_offset;
+		loff_t output_pos = (loff_t)output_offset;
+		ssize_t bytes_count = copy_file_range(input_fd, &input_pos, output_fd, &output_pos, (size > SSIZE_MAX) ? SSIZE_MAX : (size_t)size, 0);
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			//Old kernels, different file systems etc. are served below:
+			break;
+		}
+
+		if (bytes_count == 0)
+		{
+			fprintf(stderr, "Error while reading from input file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		input_offset += (uint64_t)bytes_count;
+		output_offset += (uint64_t)bytes_count;
+		size -= (uint64_t)bytes_count;
+	}
+
+	if (size == 0)
+	{
+		return;
+	}
+#endif
+
+	//Bounce the rest through a buffer:
+	size_t capacity = (size < HONK_IO_DEFAULT_BUFFER_SIZE) ? (size_t)size : HONK_IO_DEFAULT_BUFFER_SIZE;
+	uint8_t* buffer = honk_io_alloc_buffer(capacity);
+
+	while (size > 0)
+	{
+		size_t count = (size < capacity) ? (size_t)size : capacity;
+
+		if (honk_io_pread_full(input_fd, buffer, count, input_offset) != count)
+		{
+			fprintf(stderr, "Error while reading from input file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		honk_io_pwrite_full(output_fd, buffer, count, output_offset);
+
+		input_offset += count;
+		output_offset += count;
+		size -= count;
+	}
+
+	honk_io_free_buffer(buffer);
+}
+
+bool honk_io_map_input(honk_mapping_t* mapping, int fd, off_t offset)
+{
+	struct stat stat_buf;
+
+	if ((offset < 0) || (fstat(fd, &stat_buf) != 0) || !S_ISREG(stat_buf.st_mode) || (stat_buf.st_size <= offset))
+	{
+		return false;
+	}
+
+	//Mappings start at page boundaries:
+	off_t page_offset = offset - offset % (off_t)sysconf(_SC_PAGESIZE);
+	uint64_t length = (uint64_t)(stat_buf.st_size - page_offset);
+
+	if (length > SIZE_MAX)
+	{
+		return false;
+	}
+
+	void* base = mmap(NULL, (size_t)length, PROT_READ, MAP_PRIVATE, fd, page_offset);
+
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+
+	//These are only hints, so they may fail silently:
+#ifdef MADV_SEQUENTIAL
+	madvise(base, (size_t)length, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+	madvise(base, (size_t)length, MADV_HUGEPAGE);
+#endif
+
+	mapping->base = base;
+	mapping->length = (size_t)length;
+	mapping->data = (uint8_t*)base + (offset - page_offset);
+	mapping->fd = fd;
+	mapping->offset = (uint64_t)offset;
+	mapping->count = (size_t)(stat_buf.st_size - offset);
+
+	return true;
+}
+
+bool honk_io_resize_zeroed(int fd, off_t offset, uint64_t size)
+{
+	struct stat stat_buf;
+
+	if ((fstat(fd, &stat_buf) != 0) || (ftruncate(fd, offset + (off_t)size) != 0))
+	{
+		fprintf(stderr, "Error while writing to output file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Bytes behind the old end of the file read as zeros anyway, the others are punched out:
+	if (stat_buf.st_size <= offset)
+	{
+		return true;
+	}
+
+#if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+	off_t punch_end = (stat_buf.st_size < offset + (off_t)size) ? stat_buf.st_size : (offset + (off_t)size);
+	return (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, punch_end - offset) == 0);
+#else
+	return false;
+#endif
+}
+
+void honk_io_pwrite_sparse(int fd, const uint8_t* src, size_t size, uint64_t offset)
+{
+	for (size_t i = 0, end; i < size; i = end)
+	{
+		bool is_hole = false;
+		end = find_span(src, i, size, offset, &is_hole);
+
+		if (!is_hole)
+		{
+			honk_io_pwrite_full(fd, src + i, end - i, offset + i);
+		}
+	}
+}
+
+bool honk_io_map_output(honk_mapping_t* mapping, int fd, off_t offset, uint64_t size)
+{
+	bool is_zeroed = honk_io_resize_zeroed(fd, offset, size);
+
+	//Mappings start at page boundaries:
+	off_t page_offset = offset - offset % (off_t)sysconf(_SC_PAGESIZE);
+	uint64_t length = (uint64_t)(offset - page_offset) + size;
+
+	if ((size == 0) || (length > SIZE_MAX))
+	{
+		return false;
+	}
+
+	void* base = mmap(NULL, (size_t)length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, page_offset);
+
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+
+	mapping->base = base;
+	mapping->length = (size_t)length;
+	mapping->data = (uint8_t*)base + (offset - page_offset);
+	mapping->fd = fd;
+	mapping->offset = (uint64_t)offset;
+	mapping->is_zeroed = is_zeroed;
+	mapping->count = (size_t)size;
+
+	return true;
+}
+
+void honk_io_unmap(honk_mapping_t* mapping)
+{
+	munmap(mapping->base, mapping->length);
+
+	mapping->base = NULL;
+	mapping->length = 0;
+	mapping->data = NULL;
+	mapping->count = 0;
+}
+
+void honk_input_init(honk_input_t* input, int fd, size_t capacity)
+{
+	input->fd = fd;
+	input->data = honk_io_alloc_buffer(capacity);
+	input->capacity = capacity;
+	input->pos = 0;
+	input->count = 0;
+	input->offset = 0;
+	input->dropped_offset = 0;
+	input->uring = NULL;
+	input->pipeline = NULL;
+
+	//We read front to back exactly once:
+	honk_io_advise_sequential(fd);
+}
+
+void honk_input_init_async(honk_input_t* input, int fd, size_t capacity, bool is_direct)
+{
+	honk_input_init(input, fd, capacity);
+	input->uring = honk_uring_reader_create(fd, honk_io_tell(fd), capacity, is_direct);
+}
+
+void honk_input_init_pipelined(honk_input_t* input, int fd, size_t capacity)
+{
+	honk_input_init(input, fd, capacity);
+	input->pipeline = honk_pipeline_reader_create(fd, capacity);
+}
+
+void honk_input_destroy(honk_input_t* input)
+{
+	if (input->uring != NULL)
+	{
+		honk_uring_reader_destroy(input->uring);
+		input->uring = NULL;
+	}
+
+	if (input->pipeline != NULL)
+	{
+		honk_pipeline_reader_destroy(input->pipeline);
+		input->pipeline = NULL;
+	}
+
+	honk_io_free_buffer(input->data);
+	input->data = NULL;
+}
+
+size_t honk_input_refill(honk_input_t* input)
+{
+	//Keep the byte in front of the unconsumed ones and move everything to the front:
+	if (input->pos > 0)
+	{
+		input->data[-1] = input->data[input->pos - 1];
+		input->count -= input->pos;
+		memmove(input->data, input->data + input->pos, input->count);
+		input->pos = 0;
+	}
+
+	drop_consumed_input(input);
+
+	//The reader has the next bytes waiting already:
+	if (input->uring != NULL)
+	{
+		size_t count = honk_uring_reader_read(input->uring, input->data + input->count, input->capacity - input->count);
+
+		input->count += count;
+		input->offset += (off_t)count;
+
+		return count;
+	}
+
+	if (input->pipeline != NULL)
+	{
+		size_t count = honk_pipeline_reader_read(input->pipeline, input->data + input->count, input->capacity - input->count);
+
+		input->count += count;
+		input->offset += (off_t)count;
+
+		return count;
+	}
+
+	ssize_t bytes_count;
+
+	do
+	{
+		bytes_count = read(input->fd, input->data + input->count, input->capacity - input->count);
+	}
+	while ((bytes_count < 0) && (errno == EINTR));
+
+	if (bytes_count < 0)
+	{
+		fprintf(stderr, "Error while reading from input file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	input->count += (size_t)bytes_count;
+	input->offset += (off_t)bytes_count;
+
+	return (size_t)bytes_count;
+}
+
+bool honk_input_ensure(honk_input_t* input, size_t size)
+{
+	while (input->count - input->pos < size)
+	{
+		if (honk_input_refill(input) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void honk_input_grow(honk_input_t* input, size_t capacity)
+{
+	if (capacity <= input->capacity)
+	{
+		return;
+	}
+
+	//Take over the byte in front of the buffer, too:
+	uint8_t* data = honk_io_alloc_buffer(capacity);
+	memcpy(data - 1, input->data - 1, 1 + input->count);
+
+	honk_io_free_buffer(input->data);
+	input->data = data;
+	input->capacity = capacity;
+}
+
+void honk_output_init(honk_output_t* output, int fd, size_t capacity)
+{
+	output->fd = fd;
+	output->data = honk_io_alloc_buffer(capacity);
+	output->capacity = capacity;
+	output->count = 0;
+	output->offset = 0;
+	output->uring = NULL;
+	output->pipeline = NULL;
+	output->splice = NULL;
+	output->is_sparse = false;
+	output->is_hole_pending = false;
+	output->is_fixed = false;
+	output->is_overflowed = false;
+}
+
+void honk_output_enable_sparse(honk_output_t* output)
+{
+	//Only a file that ends at the output reads as zeros behind it:
+	struct stat stat_buf;
+
+	output->is_sparse = (output->fd >= 0) && honk_io_is_writable_file(output->fd) && (fstat(output->fd, &stat_buf) == 0) && (stat_buf.st_size <= honk_io_tell(output->fd));
+}
+
+void honk_output_init_async(honk_output_t* output, int fd, size_t capacity, bool is_direct)
+{
+	honk_output_init(output, fd, capacity);
+	output->uring = honk_uring_writer_create(fd, honk_io_tell(fd), capacity, is_direct);
+
+	//The writer brings its own (aligned) blocks:
+	if (output->uring != NULL)
+	{
+		honk_io_free_buffer(output->data);
+		output->data = honk_uring_writer_block(output->uring);
+		output->capacity = honk_uring_writer_block_size(output->uring);
+	}
+}
+
+void honk_output_init_pipelined(honk_output_t* output, int fd, size_t capacity)
+{
+	honk_output_init(output, fd, capacity);
+	output->pipeline = honk_pipeline_writer_create(fd, capacity);
+
+	//The writer thread hands out its blocks:
+	if (output->pipeline != NULL)
+	{
+		honk_io_free_buffer(output->data);
+		output->data = honk_pipeline_writer_block(output->pipeline);
+	}
+}
+
+void honk_output_init_spliced(honk_output_t* output, int fd, size_t capacity)
+{
+	honk_output_init(output, fd, capacity);
+	output->splice = honk_splice_writer_create(fd, capacity);
+
+	//The pages come from the pool of the writer:
+	if (output->splice != NULL)
+	{
+		honk_io_free_buffer(output->data);
+		output->data = honk_splice_writer_block(output->splice);
+		output->capacity = honk_splice_writer_block_size(output->splice);
+	}
+}
+
+void honk_output_init_memory(honk_output_t* output, size_t capacity)
+{
+	honk_output_init(output, -1, capacity);
+}
+
+void honk_output_init_fixed(honk_output_t* output, uint8_t* data, size_t capacity)
+{
+	output->fd = -1;
+	output->data = data;
+	output->capacity = capacity;
+	output->count = 0;
+	output->offset = 0;
+	output->is_sparse = false;
+	output->is_hole_pending = false;
+	output->is_fixed = true;
+	output->is_overflowed = false;
+	output->uring = NULL;
+	output->pipeline = NULL;
+	output->splice = NULL;
+}
+
+void honk_output_destroy(honk_output_t* output)
+{
+	//The writer writes the rest and releases its blocks:
+	if (output->uring != NULL)
+	{
+		honk_uring_writer_destroy(output->uring, output->data, output->count);
+		output->offset += output->count;
+		output->count = 0;
+		output->data = NULL;
+		output->uring = NULL;
+
+		return;
+	}
+
+	if (output->pipeline != NULL)
+	{
+		honk_pipeline_writer_destroy(output->pipeline, output->data, output->count);
+		output->offset += output->count;
+		output->count = 0;
+		output->data = NULL;
+		output->pipeline = NULL;
+
+		return;
+	}
+
+	if (output->splice != NULL)
+	{
+		honk_splice_writer_destroy(output->splice, output->data, output->count);
+		output->offset += output->count;
+		output->count = 0;
+		output->data = NULL;
+		output->splice = NULL;
+
+		return;
+	}
+
+	honk_output_flush(output);
+
+	//Give a file that ends in a hole its full size:
+	if (output->is_hole_pending && (ftruncate(output->fd, honk_io_tell(output->fd)) != 0))
+	{
+		fprintf(stderr, "Error while writing to output file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	honk_io_free_buffer(output->data);
+	output->data = NULL;
+}
+
+void honk_output_flush(honk_output_t* output)
+{
+	if (output->fd < 0)
+	{
+		return;
+	}
+
+	//The writer swaps in the next block (and may keep an unaligned rest for O_DIRECT):
+	if (output->uring != NULL)
+	{
+		size_t count = output->count;
+
+		output->data = honk_uring_writer_submit(output->uring, output->data, &output->count);
+		output->offset += count - output->count;
+
+		return;
+	}
+
+	//The writer thread takes the block and hands out a free one:
+	if (output->pipeline != NULL)
+	{
+		output->data = honk_pipeline_writer_submit(output->pipeline, output->data, output->count);
+		output->offset += output->count;
+		output->count = 0;
+
+		return;
+	}
+
+	//The pipe gets the pages themselves:
+	if (output->splice != NULL)
+	{
+		output->data = honk_splice_writer_submit(output->splice, output->data, output->count);
+		output->offset += output->count;
+		output->count = 0;
+
+		return;
+	}
+
+	if (output->is_sparse)
+	{
+		write_sparse(output);
+	}
+	else
+	{
+		honk_io_write_full(output->fd, output->data, output->count);
+	}
+
+	output->offset += output->count;
+	output->count = 0;
+}
+
+void honk_output_write(honk_output_t* output, const uint8_t* src, size_t size)
+{
+	while (size > 0)
+	{
+		//Fill the buffer as far as it goes, then flush it (or grow it):
+		size_t count = output->capacity - output->count;
+
+		if (count == 0)
+		{
+			honk_output_make_room(output, size);
+			continue;
+		}
+
+		count = (count < size) ? count : size;
+		memcpy(output->data + output->count, src, count);
+		honk_output_commit(output, count);
+
+		src += count;
+		size -= count;
+	}
+}
+
+void honk_output_fill(honk_output_t* output, uint8_t byte, size_t size)
+{
+	while (size > 0)
+	{
+		size_t count = output->capacity - output->count;
+
+		if (count == 0)
+		{
+			honk_output_make_room(output, size);
+			continue;
+		}
+
+		count = (count < size) ? count : size;
+		memset(output->data + output->count, byte, count);
+		honk_output_commit(output, count);
+
+		size -= count;
+	}
+}
+
+void honk_output_make_room(honk_output_t* output, size_t size)
+{
+	if (output->fd >= 0)
+	{
+		honk_output_flush(output);
+		return;
+	}
+
+	//The memory of the caller cannot grow. Its contents are lost anyway, so the writers go on at the front and the caller reports the error:
+	if (output->is_fixed)
+	{
+		output->is_overflowed = true;
+		output->count = 0;
+
+		return;
+	}
+
+	//Grow the memory buffer geometrically:
+	size_t capacity = output->capacity;
+
+	while (capacity - output->count < size)
+	{
+		capacity = (capacity > 0) ? (2 * capacity) : size;
+	}
+
+	uint8_t* storage = realloc(output->data - 1, 1 + capacity + HONK_IO_SLACK);
+
+	if (storage == NULL)
+	{
+		fprintf(stderr, "Error while allocating I/O buffer.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	output->data = storage + 1;
+	output->capacity = capacity;
+}
@@ -0,0 +1,225 @@
+#ifndef __HONK_IO_H__
+#define __HONK_IO_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "honk_pipeline.h"
+#include "honk_splice.h"
+#include "honk_uring.h"
+
+//Default size of the I/O buffers (1 MiB):
+#define HONK_IO_DEFAULT_BUFFER_SIZE ((size_t)1 << 20)
+
+//Smallest supported buffer size:
+#define HONK_IO_MIN_BUFFER_SIZE ((size_t)4096)
+
+//Every buffer has this many accessible bytes behind its capacity.
+//The codecs use them to move whole tokens without tail handling.
+#define HONK_IO_SLACK 128
+
+//Buffered input on a raw file descriptor.
+//The unconsumed bytes are data[pos] ... data[count - 1].
+//data[-1] always holds the byte in front of data[0] (or 0 at the start of the stream).
+typedef struct __honk_input_t__
+{
+	int fd;
+	uint8_t* data;
+	size_t capacity;
+	size_t pos;
+	size_t count;
+
+	//Stream offset of data[count] and the offset up to which we have dropped the page cache:
+	off_t offset;
+	off_t dropped_offset;
+
+	//Reads ahead through io_uring or a reader thread (both NULL for read()):
+	honk_uring_reader_t* uring;
+	honk_pipeline_reader_t* pipeline;
+} honk_input_t;
+
+//Buffered output on a raw file descriptor (or in memory, if fd < 0).
+//The pending bytes are data[0] ... data[count - 1].
+typedef struct __honk_output_t__
+{
+	int fd;
+	uint8_t* data;
+	size_t capacity;
+	size_t count;
+
+	//Number of bytes that have been flushed before data[0]:
+	uint64_t offset;
+
+	//Decompressed data is written sparsely to regular files that end at the output: pages of zeros are seeked over instead of written.
+	//A hole at the very end is only there once the file is resized on destroy.
+	bool is_sparse;
+	bool is_hole_pending;
+
+	//A fixed output writes into memory of the caller, which it can neither grow nor release.
+	//If the writers ask for more room than is left, it starts over at the front and is_overflowed tells the caller.
+	bool is_fixed;
+	bool is_overflowed;
+
+	//Writes behind through io_uring or a writer thread, or maps pages into a pipe (all NULL for write()). They own data then.
+	honk_uring_writer_t* uring;
+	honk_pipeline_writer_t* pipeline;
+	honk_splice_writer_t* splice;
+} honk_output_t;
+
+//A mapping of a regular file (read-only for inputs).
+//The mapped bytes are data[0] ... data[count - 1].
+typedef struct __honk_mapping_t__
+{
+	uint8_t* data;
+	size_t count;
+
+	//The mapped file and the file offset of data[0]:
+	int fd;
+	uint64_t offset;
+
+	//Does an output mapping read as zeros (so holes can be left alone)?
+	bool is_zeroed;
+
+	//The mapping itself starts at a page boundary in front of data:
+	void* base;
+	size_t length;
+} honk_mapping_t;
+
+//Allocate a buffer with one byte of lookbehind in front and HONK_IO_SLACK bytes behind the capacity:
+uint8_t* honk_io_alloc_buffer(size_t capacity);
+
+//Release a buffer from honk_io_alloc_buffer():
+void honk_io_free_buffer(uint8_t* buffer);
+
+//Hint the kernel that the file descriptor is read front to back:
+void honk_io_advise_sequential(int fd);
+
+//Is the file descriptor a regular file we may pwrite() into (i.e. not opened with O_APPEND)?
+bool honk_io_is_writable_file(int fd);
+
+//Get the current offset of a seekable file descriptor (-1 for pipes etc.):
+off_t honk_io_tell(int fd);
+
+//Read until size bytes are there or the stream ends. Returns the number of read bytes.
+size_t honk_io_read_full(int fd, uint8_t* dst, size_t size);
+
+//Write all bytes to the file descriptor:
+void honk_io_write_full(int fd, const uint8_t* src, size_t size);
+
+//Read until size bytes at the given file offset are there or the file ends. Returns the number of read bytes.
+size_t honk_io_pread_full(int fd, uint8_t* dst, size_t size, uint64_t offset);
+
+//Same as honk_io_pread_full(), but returns -1 on errors instead of quitting (errno is kept):
+ssize_t honk_io_try_pread_full(int fd, uint8_t* dst, size_t size, uint64_t offset);
+
+//Write all bytes to the given file offset:
+void honk_io_pwrite_full(int fd, const uint8_t* src, size_t size, uint64_t offset);
+
+//Copy size bytes between two files at the given offsets (the file offsets stay as they are).
+//copy_file_range() keeps the bytes in the kernel (and may share the blocks on file systems with reflinks); pread() / pwrite() take over where it is unavailable.
+void honk_io_copy_range(int input_fd, uint64_t input_offset, int output_fd, uint64_t output_offset, uint64_t size);
+
+//Map a regular file from the given offset to its end and hint the kernel that it is read front to back.
+//Returns false if the file cannot be mapped (pipes, empty files, ...), so the caller can fall back to read().
+bool honk_io_map_input(honk_mapping_t* mapping, int fd, off_t offset);
+
+//Resize a regular file so it ends size bytes behind the given offset.
+//Old contents of the bytes behind the offset are punched out where the file system allows it. Returns true if the bytes read as zeros then.
+bool honk_io_resize_zeroed(int fd, off_t offset, uint64_t size);
+
+//Same as honk_io_pwrite_full(), for a region that reads as zeros: whole pages of zeros are left out, so they stay holes.
+void honk_io_pwrite_sparse(int fd, const uint8_t* src, size_t size, uint64_t offset);
+
+//Resize a regular file with honk_io_resize_zeroed() and map the bytes behind the offset for writing.
+//Returns false if they cannot be mapped (the file keeps its new size).
+bool honk_io_map_output(honk_mapping_t* mapping, int fd, off_t offset, uint64_t size);
+
+//Release a mapping from honk_io_map_input() or honk_io_map_output():
+void honk_io_unmap(honk_mapping_t* mapping);
+
+//Set up an input on the given file descriptor:
+void honk_input_init(honk_input_t* input, int fd, size_t capacity);
+
+//Same as honk_input_init(), but regular files are read ahead through io_uring (with O_DIRECT if is_direct is set and the file supports it).
+//Falls back to read() if io_uring is unavailable.
+void honk_input_init_async(honk_input_t* input, int fd, size_t capacity, bool is_direct);
+
+//Same as honk_input_init(), but any file descriptor is read ahead by a reader thread.
+//Falls back to read() if the thread cannot be started.
+void honk_input_init_pipelined(honk_input_t* input, int fd, size_t capacity);
+
+//Release the buffer of an input:
+void honk_input_destroy(honk_input_t* input);
+
+//Move the unconsumed bytes to the front of the buffer and append as many new bytes as a single read() delivers.
+//Returns the number of new bytes (0 at the end of the stream).
+size_t honk_input_refill(honk_input_t* input);
+
+//Refill until at least size (<= capacity) unconsumed bytes are there. Returns false if the stream ends before.
+bool honk_input_ensure(honk_input_t* input, size_t size);
+
+//Enlarge the buffer to at least the given capacity (the unconsumed bytes are kept):
+void honk_input_grow(honk_input_t* input, size_t capacity);
+
+//Set up an output on the given file descriptor:
+void honk_output_init(honk_output_t* output, int fd, size_t capacity);
+
+//Skip blocks of zeros as holes if the output is a regular file that ends at its offset (before anything is written).
+//Decompressed data is worth it, compressed data hardly has such blocks.
+void honk_output_enable_sparse(honk_output_t* output);
+
+//Same as honk_output_init(), but regular files are written behind through io_uring (with O_DIRECT if is_direct is set and the file supports it).
+//Falls back to write() if io_uring is unavailable.
+void honk_output_init_async(honk_output_t* output, int fd, size_t capacity, bool is_direct);
+
+//Same as honk_output_init(), but any file descriptor is written behind by a writer thread.
+//Falls back to write() if the thread cannot be started.
+void honk_output_init_pipelined(honk_output_t* output, int fd, size_t capacity);
+
+//Same as honk_output_init(), but the pages are mapped into the pipe with vmsplice() if the file descriptor is a pipe (see honk_splice_writer_t).
+//Falls back to write() for everything else.
+void honk_output_init_spliced(honk_output_t* output, int fd, size_t capacity);
+
+//Set up an output that collects everything in a growing memory buffer:
+void honk_output_init_memory(honk_output_t* output, size_t capacity);
+
+//Set up an output on capacity bytes of memory of the caller (without slack behind them).
+//A single reservation must not ask for more than capacity bytes. Running out of room is recorded in is_overflowed, and there is nothing to destroy.
+void honk_output_init_fixed(honk_output_t* output, uint8_t* data, size_t capacity);
+
+//Flush and release the buffer of an output:
+void honk_output_destroy(honk_output_t* output);
+
+//Write all pending bytes to the file descriptor (memory outputs keep them):
+void honk_output_flush(honk_output_t* output);
+
+//Append bytes, flushing (or growing memory outputs) as necessary:
+void honk_output_write(honk_output_t* output, const uint8_t* src, size_t size);
+
+//Same as honk_output_write(), for size copies of a single byte:
+void honk_output_fill(honk_output_t* output, uint8_t byte, size_t size);
+
+//Make space for at least size bytes by flushing (or growing memory outputs):
+void honk_output_make_room(honk_output_t* output, size_t size);
+
+//Get space for at least size bytes (size <= capacity for file descriptors), flushing if necessary.
+//The caller writes into the returned space and commits the number of actually used bytes.
+static inline uint8_t* honk_output_reserve(honk_output_t* output, size_t size)
+{
+	if (output->capacity - output->count < size)
+	{
+		honk_output_make_room(output, size);
+	}
+
+	return output->data + output->count;
+}
+
+//Commit bytes that have been written into reserved space:
+static inline void honk_output_commit(honk_output_t* output, size_t size)
+{
+	output->count += size;
+}
+
+#endif
@@ -0,0 +1,869 @@
+#include "honk_parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "honk_codec.h"
+#include "honk_io.h"
+#include "honk_pool.h"
+
+//Number of bytes that are re-encoded at the start of a chunk before we give up on the worker's tokens (runs do not count):
+#define SYNC_LIMIT ((size_t)64 << 10)
+
+//Runs are measured this many bytes at a time:
+#define RUN_PATTERN_SIZE ((size_t)64)
+
+typedef struct __honk_parallel_t__ honk_parallel_t;
+
+//A slot of the reorder window:
+typedef struct __honk_chunk_t__
+{
+	honk_parallel_t* parallel;
+
+	//input[-1] holds the last byte of the previous chunk:
+	uint8_t* input;
+	size_t input_count;
+
+	//The tokens of a fresh encoder and the state it ends in (the pending run or block is not written):
+	honk_output_t output;
+	honk_encoder_t encoder;
+
+	//Guarded by the lock of the parallel context:
+	bool is_done;
+} honk_chunk_t;
+
+struct __honk_parallel_t__
+{
+	honk_chunk_t* chunks;
+	size_t window_size;
+	honk_format_t format;
+	honk_layout_t layout;
+
+	//Signalled whenever a chunk is done:
+	pthread_mutex_t lock;
+	pthread_cond_t chunk_done;
+};
+
+//Shared by the workers that decode an indexed container:
+typedef struct __honk_indexed_t__
+{
+	const honk_index_t* index;
+	int input_fd;
+	int output_fd;
+	uint64_t container_offset;
+	uint64_t output_offset;
+
+	//Mapped input and output (the file descriptors are used for stored chunks only then):
+	const uint8_t* input;
+	uint8_t* output;
+
+	//Does the output read as zeros, so holes can be left out?
+	bool is_output_zeroed;
+
+	//Size of the output buffers of the workers (the largest chunk of the table that the header allows):
+	size_t max_uncompressed_size;
+
+	atomic_size_t next_chunk;
+	atomic_bool is_bad_format;
+} honk_indexed_t;
+
+typedef struct __honk_segment_t__ honk_segment_t;
+
+//A run of complete tokens and the place of its bytes in the output of the segment:
+typedef struct __honk_piece_t__
+{
+	honk_segment_t* segment;
+
+	size_t input_begin;
+	size_t input_end;
+	size_t output_begin;
+	size_t output_count;
+} honk_piece_t;
+
+//A part of the compressed stream that is decoded at once:
+struct __honk_segment_t__
+{
+	uint8_t* input;
+	size_t input_capacity;
+	size_t input_count;
+
+	//The complete tokens end here (the rest is carried over to the next segment):
+	size_t scanned_count;
+
+	uint8_t* output;
+	size_t output_capacity;
+	size_t output_count;
+
+	honk_piece_t* pieces;
+	size_t pieces_count;
+	bool is_full;
+
+	//Guarded by the lock of the decompressor:
+	size_t pending_count;
+	pthread_mutex_t* lock;
+	pthread_cond_t* pieces_done;
+};
+
+//Joins the chunks to the stream a serial encoder would have written, where it can (owned by the writing thread):
+typedef struct __honk_stitcher_t__
+{
+	//The state of the serial encoder at the end of the last written chunk:
+	honk_encoder_t encoder;
+
+	//Scratch outputs for the re-encoded start of a chunk:
+	honk_output_t serial_output;
+	honk_output_t fresh_output;
+} honk_stitcher_t;
+
+//Compress a single chunk (runs on a worker thread):
+static void compress_chunk(void* context);
+
+//Decode a single piece (runs on a worker thread):
+static void decompress_piece(void* context);
+
+//Phase 1: Take over the carried bytes, read more input and hop over the complete tokens to cut them into pieces.
+//Returns true at the end of the input.
+static bool scan_segment(honk_segment_t* segment, const uint8_t* carry, size_t carry_count, int input_fd, size_t chunk_size, size_t max_pieces_count);
+
+//Phase 2: Decode the pieces of a segment on the pool:
+static void submit_segment(honk_segment_t* segment, honk_pool_t* pool);
+
+//Wait until all pieces of a segment are decoded:
+static void wait_for_segment(honk_segment_t* segment);
+
+//Decode chunks of an indexed container until there are none left (runs on a worker thread):
+static void decompress_indexed_chunks(void* context);
+
+//Same as decompress_indexed_chunks(), from the mapped input into the mapped output:
+static void decompress_mapped_chunks(void* context);
+
+//Do two encoders emit the same tokens from here on?
+static bool is_in_sync(const honk_encoder_t* encoder, const honk_encoder_t* other_encoder);
+
+//Find the first byte in [begin, end) that differs from the given one, or end:
+static size_t find_run_end(const uint8_t* bytes, size_t begin, size_t end, uint8_t byte);
+
+//Write a chunk so that the output matches the serial encoder as far as the encoders can be synchronized (runs on the writing thread):
+static void stitch_chunk(honk_stitcher_t* stitcher, honk_chunk_t* chunk, int output_fd);
+
+static void compress_chunk(void* context)
+{
+	honk_chunk_t* chunk = context;
+	honk_parallel_t* parallel = chunk->parallel;
+
+	//Start from scratch:
+	honk_encoder_init(&chunk->encoder, parallel->layout);
+
+	if (parallel->format == HONK_FORMAT_V2)
+	{
+		//Frame the chunk as a complete token stream:
+		chunk->output.count = HONK_V2_CHUNK_HEADER_SIZE;
+
+		honk_encoder_update(&chunk->encoder, chunk->input, chunk->input_count, &chunk->output);
+		honk_encoder_finish(&chunk->encoder, &chunk->output);
+
+		honk_v2_chunk_header_t chunk_header = { (uint32_t)(chunk->output.count - HONK_V2_CHUNK_HEADER_SIZE), (uint32_t)chunk->input_count, false };
+
+		//Incompressible chunks are stored as they are, so they cost no more than their chunk header:
+		if (chunk_header.payload_size > chunk_header.uncompressed_size)
+		{
+			memcpy(chunk->output.data + HONK_V2_CHUNK_HEADER_SIZE, chunk->input, chunk->input_count);
+			chunk->output.count = HONK_V2_CHUNK_HEADER_SIZE + chunk->input_count;
+
+			chunk_header.payload_size = chunk_header.uncompressed_size;
+			chunk_header.is_stored = true;
+		}
+
+		honk_v2_write_chunk_header(chunk->output.data, &chunk_header);
+	}
+	else
+	{
+		//Keep the pending run or block, the stitcher takes care of the boundaries:
+		honk_encoder_update(&chunk->encoder, chunk->input, chunk->input_count, &chunk->output);
+	}
+
+	pthread_mutex_lock(&parallel->lock);
+	chunk->is_done = true;
+	pthread_cond_broadcast(&parallel->chunk_done);
+	pthread_mutex_unlock(&parallel->lock);
+}
+
+static bool is_in_sync(const honk_encoder_t* encoder, const honk_encoder_t* other_encoder)
+{
+	//The pending bytes are always the last count bytes of the input, so state and count are all that matters:
+	return (encoder->state == other_encoder->state) && (encoder->count == other_encoder->count);
+}
+
+static size_t find_run_end(const uint8_t* bytes, size_t begin, size_t end, uint8_t byte)
+{
+	uint8_t pattern[RUN_PATTERN_SIZE];
+	memset(pattern, byte, sizeof(pattern));
+
+	size_t i = begin;
+
+	while ((end - i >= RUN_PATTERN_SIZE) && (memcmp(bytes + i, pattern, RUN_PATTERN_SIZE) == 0))
+	{
+		i += RUN_PATTERN_SIZE;
+	}
+
+	while ((i < end) && (bytes[i] == byte))
+	{
+		i++;
+	}
+
+	return i;
+}
+
+static void stitch_chunk(honk_stitcher_t* stitcher, honk_chunk_t* chunk, int output_fd)
+{
+	//The worker has started with a fresh encoder, but the serial encoder may be in the middle of a run or block.
+	//Feed a copy of it and a fresh one with the start of the chunk until they agree. Usually, this happens at the first run boundary.
+	honk_encoder_t serial_encoder = stitcher->encoder;
+	honk_encoder_t fresh_encoder;
+	honk_encoder_init(&fresh_encoder, stitcher->encoder.layout);
+
+	stitcher->serial_output.count = 0;
+	stitcher->fresh_output.count = 0;
+
+	size_t i = 0;
+
+	while (!is_in_sync(&serial_encoder, &fresh_encoder) && (i < chunk->input_count))
+	{
+		//The counts of a run that crosses the chunk boundary only agree once it ends, so the run is fed as a whole (however long it is).
+		//Other bytes are fed one at a time, up to the limit:
+		size_t count = 1;
+
+		if ((serial_encoder.state == HONK_COMPRESS_STATE_RLE) && (chunk->input[i] == serial_encoder.last_byte))
+		{
+			count = find_run_end(chunk->input, i, chunk->input_count, chunk->input[i]) - i;
+		}
+		else if (i >= SYNC_LIMIT)
+		{
+			break;
+		}
+
+		honk_encoder_update(&serial_encoder, chunk->input + i, count, &stitcher->serial_output);
+		honk_encoder_update(&fresh_encoder, chunk->input + i, count, &stitcher->fresh_output);
+		i += count;
+	}
+
+	if (is_in_sync(&serial_encoder, &fresh_encoder))
+	{
+		//The re-encoded tokens replace what the fresh encoder has written so far, the rest of the chunk is valid:
+		honk_io_write_full(output_fd, stitcher->serial_output.data, stitcher->serial_output.count);
+		honk_io_write_full(output_fd, chunk->output.data + stitcher->fresh_output.count, chunk->output.count - stitcher->fresh_output.count);
+
+		stitcher->encoder = chunk->encoder;
+	}
+	else if (i == chunk->input_count)
+	{
+		//The whole chunk has been re-encoded (e.g. a run that goes on behind it or a chunk below the limit):
+		honk_io_write_full(output_fd, stitcher->serial_output.data, stitcher->serial_output.count);
+
+		stitcher->encoder = serial_encoder;
+	}
+	else
+	{
+		//The encoders did not agree (e.g. on data without any runs). Rather than encoding the rest of the chunk on this thread,
+		//we end the pending run or block at the chunk boundary and take the tokens of the worker as they are.
+		//This costs a token header, and the stream differs from the one of a single thread (but decodes to the same bytes).
+		stitcher->serial_output.count = 0;
+
+		honk_encoder_finish(&stitcher->encoder, &stitcher->serial_output);
+		honk_io_write_full(output_fd, stitcher->serial_output.data, stitcher->serial_output.count);
+		honk_io_write_full(output_fd, chunk->output.data, chunk->output.count);
+
+		stitcher->encoder = chunk->encoder;
+	}
+}
+
+void honk_compress_parallel(int input_fd, int output_fd, size_t threads_count, size_t chunk_size, honk_format_t format, honk_layout_t layout)
+{
+	honk_parallel_t parallel;
+
+	parallel.format = format;
+	parallel.layout = layout;
+	parallel.window_size = threads_count * HONK_PARALLEL_WINDOW_PER_THREAD;
+	parallel.chunks = calloc(parallel.window_size, sizeof(honk_chunk_t));
+
+	if (parallel.chunks == NULL)
+	{
+		fprintf(stderr, "Error while allocating chunks.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_init(&parallel.lock, NULL);
+	pthread_cond_init(&parallel.chunk_done, NULL);
+
+	//The slots are recycled, so there is no allocation in the steady state.
+	//Most chunks compress, so the output only grows for incompressible ones.
+	for (size_t i = 0; i < parallel.window_size; i++)
+	{
+		honk_chunk_t* chunk = &parallel.chunks[i];
+
+		chunk->parallel = &parallel;
+		chunk->input = honk_io_alloc_buffer(chunk_size);
+		honk_output_init_memory(&chunk->output, chunk_size);
+	}
+
+	honk_io_advise_sequential(input_fd);
+
+	honk_stitcher_t stitcher;
+
+	honk_encoder_init(&stitcher.encoder, layout);
+	honk_output_init_memory(&stitcher.serial_output, SYNC_LIMIT);
+	honk_output_init_memory(&stitcher.fresh_output, SYNC_LIMIT);
+
+	//V2: Start with a header. If the output is seekable, we fill in the total size at the end.
+	honk_v2_header_t header = { HONK_V2_VERSION, (layout == HONK_LAYOUT_WIDE) ? HONK_V2_FLAG_WIDE_TOKENS : 0, (uint32_t)chunk_size, HONK_V2_UNKNOWN_SIZE };
+	honk_index_t index;
+	off_t container_offset = -1;
+	uint64_t compressed_offset = 0;
+	uint64_t uncompressed_offset = 0;
+
+	if (format == HONK_FORMAT_V2)
+	{
+		uint8_t header_bytes[HONK_V2_HEADER_SIZE];
+
+		honk_v2_write_header(header_bytes, &header);
+		if (honk_io_is_writable_file(output_fd))
+		{
+			container_offset = honk_io_tell(output_fd);
+		}
+
+		honk_io_write_full(output_fd, header_bytes, sizeof(header_bytes));
+		honk_index_init(&index, &header);
+
+		compressed_offset = HONK_V2_HEADER_SIZE;
+	}
+
+	honk_pool_t* pool = honk_pool_create(threads_count);
+
+	//Chunks [next_write, next_read) are in flight:
+	size_t next_read = 0;
+	size_t next_write = 0;
+	bool is_eof = false;
+	uint8_t last_byte = 0;
+
+	for (;;)
+	{
+		//Read and submit the next chunk as long as the window has space:
+		bool can_read = !is_eof && (next_read - next_write < parallel.window_size);
+
+		if (can_read)
+		{
+			honk_chunk_t* chunk = &parallel.chunks[next_read % parallel.window_size];
+
+			chunk->input_count = honk_io_read_full(input_fd, chunk->input, chunk_size);
+			is_eof = (chunk->input_count < chunk_size);
+
+			if (chunk->input_count > 0)
+			{
+				chunk->input[-1] = last_byte;
+				last_byte = chunk->input[chunk->input_count - 1];
+
+				chunk->output.count = 0;
+				chunk->is_done = false;
+
+				honk_pool_submit(pool, compress_chunk, chunk);
+				next_read++;
+			}
+		}
+
+		if (next_write == next_read)
+		{
+			if (is_eof)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		//Write the oldest chunk once it is done.
+		//We only wait for it if there is nothing left to read.
+		honk_chunk_t* chunk = &parallel.chunks[next_write % parallel.window_size];
+
+		pthread_mutex_lock(&parallel.lock);
+
+		while (!can_read && !chunk->is_done)
+		{
+			pthread_cond_wait(&parallel.chunk_done, &parallel.lock);
+		}
+
+		bool is_done = chunk->is_done;
+		pthread_mutex_unlock(&parallel.lock);
+
+		if (is_done)
+		{
+			if (format == HONK_FORMAT_V2)
+			{
+				honk_index_append(&index, compressed_offset, uncompressed_offset);
+				honk_io_write_full(output_fd, chunk->output.data, chunk->output.count);
+
+				compressed_offset += chunk->output.count;
+				uncompressed_offset += chunk->input_count;
+			}
+			else
+			{
+				stitch_chunk(&stitcher, chunk, output_fd);
+			}
+
+			next_write++;
+		}
+	}
+
+	if (format == HONK_FORMAT_V2)
+	{
+		//Finish the container:
+		index.header.total_size = uncompressed_offset;
+		index.table_offset = compressed_offset + HONK_V2_CHUNK_HEADER_SIZE;
+		honk_index_write_trailer(&index, output_fd);
+		honk_index_destroy(&index);
+
+		if (container_offset >= 0)
+		{
+			uint8_t header_bytes[HONK_V2_HEADER_SIZE];
+
+			header.total_size = uncompressed_offset;
+			honk_v2_write_header(header_bytes, &header);
+			honk_io_pwrite_full(output_fd, header_bytes, sizeof(header_bytes), (uint64_t)container_offset);
+		}
+	}
+	else
+	{
+		//Write the last block if necessary:
+		stitcher.serial_output.count = 0;
+		honk_encoder_finish(&stitcher.encoder, &stitcher.serial_output);
+		honk_io_write_full(output_fd, stitcher.serial_output.data, stitcher.serial_output.count);
+	}
+
+	honk_pool_destroy(pool);
+	honk_output_destroy(&stitcher.serial_output);
+	honk_output_destroy(&stitcher.fresh_output);
+
+	for (size_t i = 0; i < parallel.window_size; i++)
+	{
+		honk_io_free_buffer(parallel.chunks[i].input);
+		honk_output_destroy(&parallel.chunks[i].output);
+	}
+
+	pthread_cond_destroy(&parallel.chunk_done);
+	pthread_mutex_destroy(&parallel.lock);
+	free(parallel.chunks);
+}
+
+static void decompress_piece(void* context)
+{
+	honk_piece_t* piece = context;
+	honk_segment_t* segment = piece->segment;
+
+	//The scan has made sure that the tokens fill the output exactly:
+	size_t output_count = 0;
+	honk_decode_tokens(segment->input + piece->input_begin, piece->input_end - piece->input_begin, segment->output + piece->output_begin, piece->output_count, &output_count, false);
+
+	pthread_mutex_lock(segment->lock);
+
+	if (--segment->pending_count == 0)
+	{
+		pthread_cond_broadcast(segment->pieces_done);
+	}
+
+	pthread_mutex_unlock(segment->lock);
+}
+
+static bool scan_segment(honk_segment_t* segment, const uint8_t* carry, size_t carry_count, int input_fd, size_t chunk_size, size_t max_pieces_count)
+{
+	if (carry_count > 0)
+	{
+		memmove(segment->input, carry, carry_count);
+	}
+
+	segment->input_count = carry_count;
+	segment->pieces_count = 0;
+	segment->is_full = false;
+
+	size_t pos = 0;
+	size_t output_pos = 0;
+	size_t piece_begin = 0;
+	size_t piece_output_begin = 0;
+	bool is_eof = false;
+
+	for (;;)
+	{
+		//Hop from status byte to status byte. The output offsets are the prefix sums of the counts.
+		while (pos < segment->input_count)
+		{
+			honk_token_t token;
+
+			if (!honk_read_token(segment->input + pos, segment->input_count - pos, false, &token) || (segment->input_count - pos < token.size))
+			{
+				break;
+			}
+
+			pos += token.size;
+			output_pos += token.count;
+
+			//Close the piece once its input or output is large enough:
+			if ((pos - piece_begin >= chunk_size) || (output_pos - piece_output_begin >= chunk_size))
+			{
+				segment->pieces[segment->pieces_count++] = (honk_piece_t){ segment, piece_begin, pos, piece_output_begin, output_pos - piece_output_begin };
+
+				piece_begin = pos;
+				piece_output_begin = output_pos;
+
+				if (segment->pieces_count == max_pieces_count)
+				{
+					segment->is_full = true;
+					break;
+				}
+			}
+		}
+
+		if (segment->is_full || is_eof || (segment->input_count == segment->input_capacity))
+		{
+			break;
+		}
+
+		//Read the next bit of input. We read no more than a chunk at once, so only little is left over once the pieces are full.
+		size_t free_count = segment->input_capacity - segment->input_count;
+		size_t read_count = (free_count < chunk_size) ? free_count : chunk_size;
+		size_t bytes_count = honk_io_read_full(input_fd, segment->input + segment->input_count, read_count);
+
+		segment->input_count += bytes_count;
+		is_eof = (bytes_count < read_count);
+	}
+
+	//Close the last piece:
+	if (!segment->is_full && (pos > piece_begin))
+	{
+		segment->pieces[segment->pieces_count++] = (honk_piece_t){ segment, piece_begin, pos, piece_output_begin, output_pos - piece_output_begin };
+	}
+
+	segment->scanned_count = pos;
+	segment->output_count = output_pos;
+
+	//Long runs can make the pieces larger than usual (the workers are done with the previous output of the segment):
+	if (segment->output_count > segment->output_capacity)
+	{
+		honk_io_free_buffer(segment->output);
+
+		segment->output_capacity = segment->output_count;
+		segment->output = honk_io_alloc_buffer(segment->output_capacity);
+	}
+
+	return is_eof;
+}
+
+static void submit_segment(honk_segment_t* segment, honk_pool_t* pool)
+{
+	segment->pending_count = segment->pieces_count;
+
+	for (size_t i = 0; i < segment->pieces_count; i++)
+	{
+		honk_pool_submit(pool, decompress_piece, &segment->pieces[i]);
+	}
+}
+
+static void wait_for_segment(honk_segment_t* segment)
+{
+	pthread_mutex_lock(segment->lock);
+
+	while (segment->pending_count > 0)
+	{
+		pthread_cond_wait(segment->pieces_done, segment->lock);
+	}
+
+	pthread_mutex_unlock(segment->lock);
+}
+
+void honk_decompress_parallel(honk_input_t* input, int output_fd, size_t threads_count, size_t chunk_size)
+{
+	int input_fd = input->fd;
+	size_t max_pieces_count = threads_count * HONK_PARALLEL_WINDOW_PER_THREAD;
+
+	pthread_mutex_t lock;
+	pthread_cond_t pieces_done;
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&pieces_done, NULL);
+
+	//Two segments: While the workers decode one of them, we write the previous one and scan the next one.
+	//A piece ends within one token of chunk_size, so the output size of a segment is bounded (it only grows for escaped runs).
+	honk_segment_t segments[2];
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		honk_segment_t* segment = &segments[i];
+
+		segment->input_capacity = (max_pieces_count + 1) * chunk_size + input->capacity;
+		segment->input = honk_io_alloc_buffer(segment->input_capacity);
+		segment->output_capacity = max_pieces_count * (chunk_size + MAX_BLOCK_SIZE);
+		segment->output = honk_io_alloc_buffer(segment->output_capacity);
+		segment->pieces = calloc(max_pieces_count, sizeof(honk_piece_t));
+		segment->pending_count = 0;
+		segment->lock = &lock;
+		segment->pieces_done = &pieces_done;
+
+		if (segment->pieces == NULL)
+		{
+			fprintf(stderr, "Error while allocating pieces.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	honk_io_advise_sequential(input_fd);
+
+	honk_pool_t* pool = honk_pool_create(threads_count);
+
+	honk_segment_t* segment = &segments[0];
+	bool is_eof = scan_segment(segment, input->data + input->pos, input->count - input->pos, input_fd, chunk_size, max_pieces_count);
+
+	input->pos = input->count;
+
+	submit_segment(segment, pool);
+
+	//The bytes behind the last complete token of the stream:
+	const uint8_t* leftover;
+	size_t leftover_count;
+
+	for (;;)
+	{
+		//Scan the next segment while the current one is decoded.
+		//It starts with the bytes behind the complete tokens of the current segment (the workers only read them).
+		honk_segment_t* next_segment = (segment == &segments[0]) ? &segments[1] : &segments[0];
+		bool has_next_segment = !is_eof || segment->is_full;
+
+		leftover = segment->input + segment->scanned_count;
+		leftover_count = segment->input_count - segment->scanned_count;
+
+		if (has_next_segment)
+		{
+			is_eof = scan_segment(next_segment, segment->input + segment->scanned_count, leftover_count, input_fd, chunk_size, max_pieces_count);
+			has_next_segment = (next_segment->pieces_count > 0);
+			leftover = next_segment->input + next_segment->scanned_count;
+			leftover_count = next_segment->input_count - next_segment->scanned_count;
+		}
+
+		wait_for_segment(segment);
+
+		if (has_next_segment)
+		{
+			submit_segment(next_segment, pool);
+		}
+
+		honk_io_write_full(output_fd, segment->output, segment->output_count);
+
+		if (!has_next_segment)
+		{
+			break;
+		}
+
+		segment = next_segment;
+	}
+
+	honk_pool_destroy(pool);
+
+	//The stream may end with an empty block, but a token must not be cut off:
+	bool is_complete = honk_is_stream_tail(leftover, leftover_count, false);
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		honk_io_free_buffer(segments[i].input);
+		honk_io_free_buffer(segments[i].output);
+		free(segments[i].pieces);
+	}
+
+	pthread_cond_destroy(&pieces_done);
+	pthread_mutex_destroy(&lock);
+
+	if (!is_complete)
+	{
+		fprintf(stderr, "Error while decompressing: Bad format\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void decompress_indexed_chunks(void* context)
+{
+	honk_indexed_t* indexed = context;
+	const honk_index_t* index = indexed->index;
+
+	//Every worker keeps its buffers for all of its chunks:
+	size_t max_uncompressed_size = indexed->max_uncompressed_size;
+	size_t input_capacity = 0;
+	uint8_t* input = NULL;
+	uint8_t* output = honk_io_alloc_buffer(max_uncompressed_size);
+
+	for (size_t chunk = atomic_fetch_add(&indexed->next_chunk, 1); chunk < index->entries_count; chunk = atomic_fetch_add(&indexed->next_chunk, 1))
+	{
+		uint64_t compressed_offset = index->entries[chunk].compressed_offset;
+		uint64_t compressed_size = honk_index_compressed_end(index, chunk) - compressed_offset;
+		uint64_t uncompressed_size = honk_index_uncompressed_end(index, chunk) - index->entries[chunk].uncompressed_offset;
+
+		if (uncompressed_size > max_uncompressed_size)
+		{
+			atomic_store(&indexed->is_bad_format, true);
+			break;
+		}
+
+		if (compressed_size > input_capacity)
+		{
+			honk_io_free_buffer(input);
+			input_capacity = compressed_size;
+			input = honk_io_alloc_buffer(input_capacity);
+		}
+
+		uint64_t output_offset = indexed->output_offset + index->entries[chunk].uncompressed_offset;
+
+		//Stored chunks go from file to file without passing through here:
+		if (index->is_framed)
+		{
+			uint8_t header_bytes[HONK_V2_CHUNK_HEADER_SIZE];
+			honk_v2_chunk_header_t chunk_header;
+
+			bool is_valid = (honk_io_pread_full(indexed->input_fd, header_bytes, sizeof(header_bytes), indexed->container_offset + compressed_offset) == sizeof(header_bytes));
+			is_valid = is_valid && honk_index_check_chunk_header(index, chunk, header_bytes, compressed_size, &chunk_header);
+
+			if (!is_valid)
+			{
+				atomic_store(&indexed->is_bad_format, true);
+				break;
+			}
+
+			if (chunk_header.is_stored)
+			{
+				honk_io_copy_range(indexed->input_fd, indexed->container_offset + compressed_offset + HONK_V2_CHUNK_HEADER_SIZE, indexed->output_fd, output_offset, uncompressed_size);
+				continue;
+			}
+		}
+
+		//Fetch the chunk and check it against the table:
+		bool is_valid = (honk_io_pread_full(indexed->input_fd, input, compressed_size, indexed->container_offset + compressed_offset) == compressed_size);
+		is_valid = is_valid && honk_index_decode_chunk(index, chunk, input, compressed_size, output, false);
+
+		if (!is_valid)
+		{
+			atomic_store(&indexed->is_bad_format, true);
+			break;
+		}
+
+		//Put the chunk right where it belongs:
+		if (indexed->is_output_zeroed)
+		{
+			honk_io_pwrite_sparse(indexed->output_fd, output, uncompressed_size, output_offset);
+		}
+		else
+		{
+			honk_io_pwrite_full(indexed->output_fd, output, uncompressed_size, output_offset);
+		}
+	}
+
+	honk_io_free_buffer(input);
+	honk_io_free_buffer(output);
+}
+
+void honk_decompress_indexed(const honk_index_t* index, int input_fd, uint64_t container_offset, int output_fd, size_t threads_count)
+{
+	honk_indexed_t indexed;
+
+	indexed.index = index;
+	indexed.input_fd = input_fd;
+	indexed.output_fd = output_fd;
+	indexed.container_offset = container_offset;
+	indexed.output_offset = (uint64_t)honk_io_tell(output_fd);
+	atomic_init(&indexed.next_chunk, 0);
+	atomic_init(&indexed.is_bad_format, false);
+
+	//Give the output its final size up front, the chunks are then filled in out of order (leaving out the holes if it reads as zeros):
+	uint64_t output_end = indexed.output_offset + index->header.total_size;
+	indexed.is_output_zeroed = honk_io_resize_zeroed(output_fd, (off_t)indexed.output_offset, index->header.total_size);
+
+	//The workers size their buffers for the largest chunk of the table (one that is larger than the header allows is rejected anyway):
+	uint64_t max_uncompressed_size = honk_index_max_uncompressed_size(index);
+	indexed.max_uncompressed_size = (size_t)((max_uncompressed_size < index->header.chunk_size) ? max_uncompressed_size : index->header.chunk_size);
+
+	//Each worker pulls chunks until there are none left:
+	honk_pool_t* pool = honk_pool_create(threads_count);
+
+	for (size_t i = 0; i < threads_count; i++)
+	{
+		honk_pool_submit(pool, decompress_indexed_chunks, &indexed);
+	}
+
+	honk_pool_destroy(pool);
+
+	if (atomic_load(&indexed.is_bad_format))
+	{
+		fprintf(stderr, "Error while decompressing: Bad format\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Leave the file offset behind the output, as if we had written it sequentially:
+	lseek(output_fd, (off_t)output_end, SEEK_SET);
+}
+
+static void decompress_mapped_chunks(void* context)
+{
+	honk_indexed_t* indexed = context;
+	const honk_index_t* index = indexed->index;
+
+	for (size_t chunk = atomic_fetch_add(&indexed->next_chunk, 1); chunk < index->entries_count; chunk = atomic_fetch_add(&indexed->next_chunk, 1))
+	{
+		uint64_t compressed_offset = index->entries[chunk].compressed_offset;
+		size_t compressed_size = (size_t)(honk_index_compressed_end(index, chunk) - compressed_offset);
+		uint64_t uncompressed_offset = index->entries[chunk].uncompressed_offset;
+		honk_v2_chunk_header_t chunk_header;
+
+		//Stored chunks are copied from file to file (the kernel keeps the mappings coherent):
+		if (index->is_framed && honk_index_check_chunk_header(index, chunk, indexed->input + compressed_offset, compressed_size, &chunk_header) && chunk_header.is_stored)
+		{
+			honk_io_copy_range(indexed->input_fd, indexed->container_offset + compressed_offset + HONK_V2_CHUNK_HEADER_SIZE, indexed->output_fd, indexed->output_offset + uncompressed_offset, chunk_header.uncompressed_size);
+			continue;
+		}
+
+		//Decode right into the place of the chunk (holes of a zeroed output stay holes):
+		if (!honk_index_decode_chunk(index, chunk, indexed->input + compressed_offset, compressed_size, indexed->output + uncompressed_offset, indexed->is_output_zeroed))
+		{
+			atomic_store(&indexed->is_bad_format, true);
+			break;
+		}
+	}
+}
+
+void honk_decompress_mapped(const honk_index_t* index, const honk_mapping_t* input, const honk_mapping_t* output, size_t threads_count)
+{
+	honk_indexed_t indexed;
+
+	indexed.index = index;
+	indexed.input = input->data;
+	indexed.output = output->data;
+	indexed.is_output_zeroed = output->is_zeroed;
+	indexed.input_fd = input->fd;
+	indexed.output_fd = output->fd;
+	indexed.container_offset = input->offset;
+	indexed.output_offset = output->offset;
+	atomic_init(&indexed.next_chunk, 0);
+	atomic_init(&indexed.is_bad_format, false);
+
+	//Each worker pulls chunks until there are none left:
+	honk_pool_t* pool = honk_pool_create(threads_count);
+
+	for (size_t i = 0; i < threads_count; i++)
+	{
+		honk_pool_submit(pool, decompress_mapped_chunks, &indexed);
+	}
+
+	honk_pool_destroy(pool);
+
+	if (atomic_load(&indexed.is_bad_format))
+	{
+		fprintf(stderr, "Error while decompressing: Bad format\n");
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef __HONK_PARALLEL_H__
+#define __HONK_PARALLEL_H__
+
+#include <stddef.h>
+
+#include "honk_container.h"
+#include "honk_io.h"
+
+//Default size of the chunks that are compressed in parallel (1 MiB):
+#define HONK_PARALLEL_DEFAULT_CHUNK_SIZE ((size_t)1 << 20)
+
+//Number of chunks per thread that may be in flight (read, compressing or waiting to be written):
+#define HONK_PARALLEL_WINDOW_PER_THREAD 2
+
+//Compress the input in chunks on a pool of threads_count workers.
+//Legacy: The chunks are stitched together in order, so the output is identical to the serial encoder.
+//Only where the encoders cannot be synchronized within SYNC_LIMIT bytes of a chunk (e.g. data without runs), a token ends at the chunk boundary.
+//V2: Every chunk is a complete token stream in its own frame, followed by the chunk table.
+//At most threads_count * HONK_PARALLEL_WINDOW_PER_THREAD chunks are held in memory.
+//The tokens have the given layout. Wide tokens need a v2 container, which is flagged accordingly.
+void honk_compress_parallel(int input_fd, int output_fd, size_t threads_count, size_t chunk_size, honk_format_t format, honk_layout_t layout);
+
+//Decompress a legacy stream on a pool of threads_count workers.
+//The input is read in segments. A fast scan hops from status byte to status byte and cuts each segment into pieces of about chunk_size bytes.
+//The pieces are then expanded in parallel into their precomputed places of the output.
+//Bytes that are already buffered by the input are taken over.
+void honk_decompress_parallel(honk_input_t* input, int output_fd, size_t threads_count, size_t chunk_size);
+
+//Decompress a v2 container with a chunk table on a pool of threads_count workers.
+//Every worker pread()s the frames of its chunks and pwrite()s the decoded bytes straight to their place in the output file.
+//Stored chunks are copied from file to file with honk_io_copy_range().
+void honk_decompress_indexed(const honk_index_t* index, int input_fd, uint64_t container_offset, int output_fd, size_t threads_count);
+
+//Decompress the chunks of an index from a mapped input (starting at the container) into a mapped output of the full uncompressed size.
+//The chunks are decoded on a pool of threads_count workers, each one straight into its own region of the output.
+//Stored chunks are copied from file to file with honk_io_copy_range() instead.
+void honk_decompress_mapped(const honk_index_t* index, const honk_mapping_t* input, const honk_mapping_t* output, size_t threads_count);
+
+#endif
@@ -0,0 +1,422 @@
+#include "honk_pipeline.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "honk_io.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+//Number of times a waiting thread polls a ring before it goes to sleep:
+#define SPIN_COUNT 1024
+
+//Keeps the producer and the consumer side of a ring on separate cache lines:
+#define CACHE_LINE_SIZE 64
+
+//Slots of a ring. There is room for every block and a stop marker, so pushing never waits.
+//It is a power of two, so the indices stay continuous when the counters wrap around.
+#define SPSC_CAPACITY 8
+
+_Static_assert(SPSC_CAPACITY > HONK_PIPELINE_DEPTH, "A ring must hold all blocks and the stop marker.");
+
+typedef struct __honk_block_t__
+{
+	uint8_t* data;
+	size_t count;
+
+	//Marks the last block of a writer:
+	bool is_last;
+} honk_block_t;
+
+//A lock-free single-producer / single-consumer ring of blocks.
+//tail is only written by the producer, head only by the consumer. A waiting consumer spins for a while and then sleeps on the futex of tail.
+typedef struct __honk_spsc_t__
+{
+	honk_block_t* slots[SPSC_CAPACITY];
+
+	_Alignas(CACHE_LINE_SIZE) atomic_uint head;
+
+	_Alignas(CACHE_LINE_SIZE) atomic_uint tail;
+	atomic_bool is_consumer_waiting;
+} honk_spsc_t;
+
+struct __honk_pipeline_reader_t__
+{
+	int fd;
+	size_t block_size;
+	honk_block_t blocks[HONK_PIPELINE_DEPTH];
+
+	//Empty blocks go to the reader thread, filled ones come back:
+	honk_spsc_t free_blocks;
+	honk_spsc_t full_blocks;
+
+	//The block the codec is consuming (owned by the codec):
+	honk_block_t* current;
+	size_t pos;
+	bool is_at_end;
+
+	pthread_t thread;
+};
+
+struct __honk_pipeline_writer_t__
+{
+	int fd;
+	size_t block_size;
+	honk_block_t blocks[HONK_PIPELINE_DEPTH];
+
+	//Filled blocks go to the writer thread, written ones come back:
+	honk_spsc_t free_blocks;
+	honk_spsc_t full_blocks;
+
+	pthread_t thread;
+};
+
+//Sleep until the value changes (or a spurious wakeup happens):
+static void wait_for_change(atomic_uint* value, unsigned expected);
+
+//Wake the thread that sleeps on the value:
+static void wake_waiter(atomic_uint* value);
+
+//Set up an empty ring:
+static void spsc_init(honk_spsc_t* spsc);
+
+//Append a block (producer only). NULL is the stop marker.
+static void spsc_push(honk_spsc_t* spsc, honk_block_t* block);
+
+//Take the oldest block, waiting for one if necessary (consumer only):
+static honk_block_t* spsc_pop(honk_spsc_t* spsc);
+
+//The main loop of a reader thread:
+static void* run_reader(void* context);
+
+//The main loop of a writer thread:
+static void* run_writer(void* context);
+
+static void wait_for_change(atomic_uint* value, unsigned expected)
+{
+#ifdef __linux__
+	syscall(SYS_futex, (unsigned*)value, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+	(void)value;
+	(void)expected;
+	sched_yield();
+#endif
+}
+
+static void wake_waiter(atomic_uint* value)
+{
+#ifdef __linux__
+	syscall(SYS_futex, (unsigned*)value, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	(void)value;
+#endif
+}
+
+static void spsc_init(honk_spsc_t* spsc)
+{
+	atomic_init(&spsc->head, 0);
+	atomic_init(&spsc->tail, 0);
+	atomic_init(&spsc->is_consumer_waiting, false);
+}
+
+static void spsc_push(honk_spsc_t* spsc, honk_block_t* block)
+{
+	unsigned tail = atomic_load_explicit(&spsc->tail, memory_order_relaxed);
+
+	spsc->slots[tail % SPSC_CAPACITY] = block;
+	atomic_store(&spsc->tail, tail + 1);
+
+	//Only a sleeping consumer costs a system call:
+	if (atomic_load(&spsc->is_consumer_waiting))
+	{
+		wake_waiter(&spsc->tail);
+	}
+}
+
+static honk_block_t* spsc_pop(honk_spsc_t* spsc)
+{
+	unsigned head = atomic_load_explicit(&spsc->head, memory_order_relaxed);
+
+	//Wait for the producer to deliver:
+	for (size_t i = 0; atomic_load_explicit(&spsc->tail, memory_order_acquire) == head; i++)
+	{
+		if (i < SPIN_COUNT)
+		{
+			continue;
+		}
+
+		//Announce the sleep and check again, so a push in between cannot be missed:
+		atomic_store(&spsc->is_consumer_waiting, true);
+		unsigned tail = atomic_load(&spsc->tail);
+
+		if (tail == head)
+		{
+			wait_for_change(&spsc->tail, tail);
+		}
+
+		atomic_store(&spsc->is_consumer_waiting, false);
+	}
+
+	honk_block_t* block = spsc->slots[head % SPSC_CAPACITY];
+	atomic_store_explicit(&spsc->head, head + 1, memory_order_release);
+
+	return block;
+}
+
+static void* run_reader(void* context)
+{
+	honk_pipeline_reader_t* reader = context;
+
+	for (;;)
+	{
+		//The stop marker ends the thread early:
+		honk_block_t* block = spsc_pop(&reader->free_blocks);
+
+		if (block == NULL)
+		{
+			break;
+		}
+
+		//A single read per block, so a pipe hands over whatever it has:
+		ssize_t bytes_count;
+
+		do
+		{
+			bytes_count = read(reader->fd, block->data, reader->block_size);
+		}
+		while ((bytes_count < 0) && (errno == EINTR));
+
+		if (bytes_count < 0)
+		{
+			fprintf(stderr, "Error while reading from input file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		//An empty block marks the end of the stream:
+		block->count = (size_t)bytes_count;
+		spsc_push(&reader->full_blocks, block);
+
+		if (bytes_count == 0)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void* run_writer(void* context)
+{
+	honk_pipeline_writer_t* writer = context;
+
+	for (;;)
+	{
+		honk_block_t* block = spsc_pop(&writer->full_blocks);
+		honk_io_write_full(writer->fd, block->data, block->count);
+
+		if (block->is_last)
+		{
+			break;
+		}
+
+		spsc_push(&writer->free_blocks, block);
+	}
+
+	return NULL;
+}
+
+honk_pipeline_reader_t* honk_pipeline_reader_create(int fd, size_t block_size)
+{
+	honk_pipeline_reader_t* reader = malloc(sizeof(honk_pipeline_reader_t));
+
+	if (reader == NULL)
+	{
+		return NULL;
+	}
+
+	reader->fd = fd;
+	reader->block_size = block_size;
+	reader->current = NULL;
+	reader->pos = 0;
+	reader->is_at_end = false;
+
+	spsc_init(&reader->free_blocks);
+	spsc_init(&reader->full_blocks);
+
+	//All blocks start out empty:
+	for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+	{
+		reader->blocks[i] = (honk_block_t){ honk_io_alloc_buffer(block_size), 0, false };
+		spsc_push(&reader->free_blocks, &reader->blocks[i]);
+	}
+
+	if (pthread_create(&reader->thread, NULL, run_reader, reader) != 0)
+	{
+		for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+		{
+			honk_io_free_buffer(reader->blocks[i].data);
+		}
+
+		free(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+void honk_pipeline_reader_destroy(honk_pipeline_reader_t* reader)
+{
+	//If the codec stops early, the thread may be waiting for a free block or sitting in read():
+	if (!reader->is_at_end)
+	{
+		spsc_push(&reader->free_blocks, NULL);
+		pthread_cancel(reader->thread);
+	}
+
+	pthread_join(reader->thread, NULL);
+
+	for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+	{
+		honk_io_free_buffer(reader->blocks[i].data);
+	}
+
+	free(reader);
+}
+
+size_t honk_pipeline_reader_read(honk_pipeline_reader_t* reader, uint8_t* dst, size_t size)
+{
+	size_t copied = 0;
+
+	while ((copied < size) && !reader->is_at_end)
+	{
+		if (reader->current == NULL)
+		{
+			reader->current = spsc_pop(&reader->full_blocks);
+			reader->pos = 0;
+
+			//The reader thread is done:
+			if (reader->current->count == 0)
+			{
+				reader->current = NULL;
+				reader->is_at_end = true;
+
+				break;
+			}
+		}
+
+		size_t count = reader->current->count - reader->pos;
+		count = (count < size - copied) ? count : (size - copied);
+
+		memcpy(dst + copied, reader->current->data + reader->pos, count);
+		reader->pos += count;
+		copied += count;
+
+		//A consumed block goes right back to the reader thread:
+		if (reader->pos == reader->current->count)
+		{
+			spsc_push(&reader->free_blocks, reader->current);
+			reader->current = NULL;
+		}
+	}
+
+	return copied;
+}
+
+honk_pipeline_writer_t* honk_pipeline_writer_create(int fd, size_t block_size)
+{
+	honk_pipeline_writer_t* writer = malloc(sizeof(honk_pipeline_writer_t));
+
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+
+	writer->fd = fd;
+	writer->block_size = block_size;
+
+	spsc_init(&writer->free_blocks);
+	spsc_init(&writer->full_blocks);
+
+	//The first block is handed out right away, the others wait in the free ring:
+	for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+	{
+		writer->blocks[i] = (honk_block_t){ honk_io_alloc_buffer(block_size), 0, false };
+
+		if (i > 0)
+		{
+			spsc_push(&writer->free_blocks, &writer->blocks[i]);
+		}
+	}
+
+	if (pthread_create(&writer->thread, NULL, run_writer, writer) != 0)
+	{
+		for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+		{
+			honk_io_free_buffer(writer->blocks[i].data);
+		}
+
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+uint8_t* honk_pipeline_writer_block(honk_pipeline_writer_t* writer)
+{
+	return writer->blocks[0].data;
+}
+
+uint8_t* honk_pipeline_writer_submit(honk_pipeline_writer_t* writer, uint8_t* data, size_t count)
+{
+	if (count == 0)
+	{
+		return data;
+	}
+
+	honk_block_t* block = writer->blocks;
+
+	while (block->data != data)
+	{
+		block++;
+	}
+
+	block->count = count;
+	spsc_push(&writer->full_blocks, block);
+
+	return spsc_pop(&writer->free_blocks)->data;
+}
+
+void honk_pipeline_writer_destroy(honk_pipeline_writer_t* writer, uint8_t* data, size_t count)
+{
+	honk_block_t* block = writer->blocks;
+
+	while (block->data != data)
+	{
+		block++;
+	}
+
+	//The last block stops the thread once it is written:
+	block->count = count;
+	block->is_last = true;
+	spsc_push(&writer->full_blocks, block);
+
+	pthread_join(writer->thread, NULL);
+
+	for (size_t i = 0; i < HONK_PIPELINE_DEPTH; i++)
+	{
+		honk_io_free_buffer(writer->blocks[i].data);
+	}
+
+	free(writer);
+}
@@ -0,0 +1,38 @@
+#ifndef __HONK_PIPELINE_H__
+#define __HONK_PIPELINE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Number of blocks that circulate between the codec and a reader / writer thread:
+#define HONK_PIPELINE_DEPTH 4
+
+//A reader thread that fills blocks from a file descriptor ahead of the codec.
+//The blocks go back and forth over two lock-free single-producer / single-consumer rings, so the steady state neither allocates nor locks.
+typedef struct __honk_pipeline_reader_t__ honk_pipeline_reader_t;
+
+//A writer thread that drains the blocks the codec has filled, connected the same way.
+typedef struct __honk_pipeline_writer_t__ honk_pipeline_writer_t;
+
+//Start a reader thread on the file descriptor with blocks of block_size bytes. Returns NULL if the thread cannot be started.
+honk_pipeline_reader_t* honk_pipeline_reader_create(int fd, size_t block_size);
+
+//Stop the reader thread and release the reader (bytes that have been read ahead are lost):
+void honk_pipeline_reader_destroy(honk_pipeline_reader_t* reader);
+
+//Copy up to size of the next bytes to dst, waiting for them if necessary. Returns 0 at the end of the stream.
+size_t honk_pipeline_reader_read(honk_pipeline_reader_t* reader, uint8_t* dst, size_t size);
+
+//Start a writer thread on the file descriptor with blocks of block_size bytes. Returns NULL if the thread cannot be started.
+honk_pipeline_writer_t* honk_pipeline_writer_create(int fd, size_t block_size);
+
+//Get the block to fill first. It is an I/O buffer of block_size bytes (see honk_io_alloc_buffer()).
+uint8_t* honk_pipeline_writer_block(honk_pipeline_writer_t* writer);
+
+//Pass count bytes of the given block to the writer thread and get the next block to fill:
+uint8_t* honk_pipeline_writer_submit(honk_pipeline_writer_t* writer, uint8_t* block, size_t count);
+
+//Pass the last count bytes of the given block, wait until everything is written and release the writer:
+void honk_pipeline_writer_destroy(honk_pipeline_writer_t* writer, uint8_t* block, size_t count);
+
+#endif
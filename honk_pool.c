@@ -0,0 +1,254 @@
+#include "honk_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct __honk_task_t__
+{
+	honk_task_func_t func;
+	void* context;
+} honk_task_t;
+
+//The task queue of a single worker (a growing ring buffer).
+//Both the owner and the thieves take tasks from the front, so the oldest tasks are always run first.
+typedef struct __honk_queue_t__
+{
+	pthread_mutex_t lock;
+	honk_task_t* tasks;
+	size_t capacity;
+	size_t head;
+	size_t count;
+
+	//The worker that owns the queue:
+	honk_pool_t* pool;
+	size_t index;
+	pthread_t thread;
+} honk_queue_t;
+
+struct __honk_pool_t__
+{
+	size_t threads_count;
+	honk_queue_t* queues;
+
+	//Number of submitted tasks that have not been taken by a worker yet:
+	atomic_size_t pending_count;
+
+	//Next queue for tasks from outside the pool:
+	atomic_size_t next_queue;
+
+	//Idle workers sleep here:
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool is_stopping;
+};
+
+//The queue of the calling worker (NULL outside the pool):
+static _Thread_local honk_queue_t* current_queue = NULL;
+
+//Append a task to a queue:
+static void queue_push(honk_queue_t* queue, honk_task_t task);
+
+//Take the oldest task from a queue. Returns false if the queue is empty.
+static bool queue_pop(honk_queue_t* queue, honk_task_t* task);
+
+//Take a task from the own queue or steal one from another worker:
+static bool find_task(honk_queue_t* queue, honk_task_t* task);
+
+//The main loop of a worker:
+static void* run_worker(void* context);
+
+static void queue_push(honk_queue_t* queue, honk_task_t task)
+{
+	pthread_mutex_lock(&queue->lock);
+
+	//Grow the ring if necessary:
+	if (queue->count == queue->capacity)
+	{
+		size_t capacity = (queue->capacity > 0) ? (2 * queue->capacity) : 16;
+		honk_task_t* tasks = malloc(capacity * sizeof(honk_task_t));
+
+		if (tasks == NULL)
+		{
+			fprintf(stderr, "Error while allocating task queue.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (size_t i = 0; i < queue->count; i++)
+		{
+			tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+		}
+
+		free(queue->tasks);
+		queue->tasks = tasks;
+		queue->capacity = capacity;
+		queue->head = 0;
+	}
+
+	queue->tasks[(queue->head + queue->count) % queue->capacity] = task;
+	queue->count++;
+
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static bool queue_pop(honk_queue_t* queue, honk_task_t* task)
+{
+	bool is_found = false;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (queue->count > 0)
+	{
+		*task = queue->tasks[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->count--;
+		is_found = true;
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return is_found;
+}
+
+static bool find_task(honk_queue_t* queue, honk_task_t* task)
+{
+	honk_pool_t* pool = queue->pool;
+
+	//Visit the own queue first, then the others:
+	for (size_t i = 0; i < pool->threads_count; i++)
+	{
+		if (queue_pop(&pool->queues[(queue->index + i) % pool->threads_count], task))
+		{
+			atomic_fetch_sub(&pool->pending_count, 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void* run_worker(void* context)
+{
+	honk_queue_t* queue = context;
+	honk_pool_t* pool = queue->pool;
+
+	current_queue = queue;
+
+	for (;;)
+	{
+		honk_task_t task;
+
+		if (find_task(queue, &task))
+		{
+			task.func(task.context);
+			continue;
+		}
+
+		//Sleep until there is something to do.
+		//A task that is pending but not visible yet is about to be pushed, so we just look again.
+		pthread_mutex_lock(&pool->lock);
+
+		while ((atomic_load(&pool->pending_count) == 0) && !pool->is_stopping)
+		{
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+
+		bool is_done = (atomic_load(&pool->pending_count) == 0) && pool->is_stopping;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (is_done)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+honk_pool_t* honk_pool_create(size_t threads_count)
+{
+	honk_pool_t* pool = calloc(1, sizeof(honk_pool_t));
+	honk_queue_t* queues = calloc(threads_count, sizeof(honk_queue_t));
+
+	if ((pool == NULL) || (queues == NULL))
+	{
+		fprintf(stderr, "Error while allocating thread pool.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	pool->threads_count = threads_count;
+	pool->queues = queues;
+	atomic_init(&pool->pending_count, 0);
+	atomic_init(&pool->next_queue, 0);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pool->is_stopping = false;
+
+	for (size_t i = 0; i < threads_count; i++)
+	{
+		pthread_mutex_init(&queues[i].lock, NULL);
+		queues[i].pool = pool;
+		queues[i].index = i;
+	}
+
+	for (size_t i = 0; i < threads_count; i++)
+	{
+		if (pthread_create(&queues[i].thread, NULL, run_worker, &queues[i]) != 0)
+		{
+			fprintf(stderr, "Error while starting worker thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return pool;
+}
+
+void honk_pool_destroy(honk_pool_t* pool)
+{
+	//Let the workers drain their queues and leave:
+	pthread_mutex_lock(&pool->lock);
+	pool->is_stopping = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->threads_count; i++)
+	{
+		pthread_join(pool->queues[i].thread, NULL);
+	}
+
+	//The workers look into each other's queues, so these must outlive all of them:
+	for (size_t i = 0; i < pool->threads_count; i++)
+	{
+		pthread_mutex_destroy(&pool->queues[i].lock);
+		free(pool->queues[i].tasks);
+	}
+
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->queues);
+	free(pool);
+}
+
+void honk_pool_submit(honk_pool_t* pool, honk_task_func_t func, void* context)
+{
+	honk_task_t task = { func, context };
+
+	//Workers keep their own tasks, everything else is spread round-robin:
+	honk_queue_t* queue = current_queue;
+
+	if ((queue == NULL) || (queue->pool != pool))
+	{
+		queue = &pool->queues[atomic_fetch_add(&pool->next_queue, 1) % pool->threads_count];
+	}
+
+	//Announce the task before it becomes visible, so the count never drops below zero:
+	atomic_fetch_add(&pool->pending_count, 1);
+	queue_push(queue, task);
+
+	//Wake up a sleeping worker:
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,23 @@
+#ifndef __HONK_POOL_H__
+#define __HONK_POOL_H__
+
+#include <stddef.h>
+
+//A task is a function that is called with its context on one of the worker threads:
+typedef void (*honk_task_func_t)(void* context);
+
+//A work-stealing thread pool.
+//Every worker owns a task queue. Idle workers steal from the queues of the others.
+typedef struct __honk_pool_t__ honk_pool_t;
+
+//Start a pool with the given number of worker threads:
+honk_pool_t* honk_pool_create(size_t threads_count);
+
+//Wait until all submitted tasks are done, stop the workers and release the pool:
+void honk_pool_destroy(honk_pool_t* pool);
+
+//Submit a task.
+//Tasks from outside the pool are spread round-robin, tasks from a worker land in its own queue.
+void honk_pool_submit(honk_pool_t* pool, honk_task_func_t func, void* context);
+
+#endif
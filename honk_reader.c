@@ -0,0 +1,506 @@
+#include "honk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "honk_codec.h"
+#include "honk_container.h"
+#include "honk_io.h"
+
+//No chunk / no prefetch request:
+#define NO_CHUNK SIZE_MAX
+
+typedef enum __honk_slot_state_t__
+{
+	HONK_SLOT_STATE_EMPTY,
+	HONK_SLOT_STATE_LOADING,
+	HONK_SLOT_STATE_READY
+} honk_slot_state_t;
+
+//A decoded chunk in the cache:
+typedef struct __honk_slot_t__
+{
+	honk_slot_state_t state;
+	size_t chunk;
+	uint8_t* data;
+	size_t count;
+
+	//Buffer for the compressed chunk, so whoever loads the slot reads and decodes without a lock:
+	uint8_t* frame;
+
+	//Tick of the last access (for LRU):
+	uint64_t last_use;
+} honk_slot_t;
+
+struct __honk_reader_t__
+{
+	int fd;
+	bool owns_fd;
+	uint64_t container_offset;
+	honk_index_t index;
+
+	//Guards everything below:
+	pthread_mutex_t lock;
+	pthread_cond_t slot_ready;
+
+	honk_slot_t* slots;
+	size_t slots_count;
+	uint64_t tick;
+	honk_reader_stats_t stats;
+
+	//Sequential access detection:
+	size_t last_chunk;
+
+	//The prefetch thread:
+	pthread_t prefetch_thread;
+	pthread_cond_t prefetch_requested;
+	size_t prefetch_chunk;
+	bool is_closing;
+};
+
+//Decode a chunk into a slot that is loading. Returns false (with errno set) on errors.
+static bool load_chunk(honk_reader_t* reader, size_t chunk, honk_slot_t* slot);
+
+//Find the cached slot of a chunk (NULL if there is none). Must be called with the lock held.
+static honk_slot_t* find_slot(honk_reader_t* reader, size_t chunk);
+
+//Pick the least recently used slot that is not loading. Must be called with the lock held.
+static honk_slot_t* pick_victim(honk_reader_t* reader);
+
+//Get the slot of a ready chunk, decoding it if necessary. Must be called with the lock held.
+static honk_slot_t* acquire_chunk(honk_reader_t* reader, size_t chunk);
+
+//The main loop of the prefetch thread:
+static void* run_prefetch(void* context);
+
+//Set up a reader on a loaded index (which is owned by the reader from now on):
+static honk_reader_t* open_with_index(int fd, uint64_t container_offset, honk_index_t* index, size_t cache_size);
+
+static bool load_chunk(honk_reader_t* reader, size_t chunk, honk_slot_t* slot)
+{
+	const honk_index_t* index = &reader->index;
+
+	uint64_t compressed_offset = index->entries[chunk].compressed_offset;
+	uint64_t compressed_size = honk_index_compressed_end(index, chunk) - compressed_offset;
+	uint64_t uncompressed_size = honk_index_uncompressed_end(index, chunk) - index->entries[chunk].uncompressed_offset;
+
+	if (uncompressed_size > index->header.chunk_size)
+	{
+		errno = EBADMSG;
+		return false;
+	}
+
+	//The frame of the slot holds the largest chunk of the table:
+	ssize_t bytes_count = honk_io_try_pread_full(reader->fd, slot->frame, compressed_size, reader->container_offset + compressed_offset);
+
+	if (bytes_count < 0)
+	{
+		return false;
+	}
+
+	//Check the chunk against the table and decode it:
+	if (((uint64_t)bytes_count != compressed_size) || !honk_index_decode_chunk(index, chunk, slot->frame, compressed_size, slot->data, false))
+	{
+		errno = EBADMSG;
+		return false;
+	}
+
+	return true;
+}
+
+static honk_slot_t* find_slot(honk_reader_t* reader, size_t chunk)
+{
+	for (size_t i = 0; i < reader->slots_count; i++)
+	{
+		if ((reader->slots[i].state != HONK_SLOT_STATE_EMPTY) && (reader->slots[i].chunk == chunk))
+		{
+			return &reader->slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static honk_slot_t* pick_victim(honk_reader_t* reader)
+{
+	honk_slot_t* victim = NULL;
+
+	for (size_t i = 0; i < reader->slots_count; i++)
+	{
+		honk_slot_t* slot = &reader->slots[i];
+
+		if (slot->state == HONK_SLOT_STATE_EMPTY)
+		{
+			return slot;
+		}
+
+		if ((slot->state == HONK_SLOT_STATE_READY) && ((victim == NULL) || (slot->last_use < victim->last_use)))
+		{
+			victim = slot;
+		}
+	}
+
+	return victim;
+}
+
+static honk_slot_t* acquire_chunk(honk_reader_t* reader, size_t chunk)
+{
+	for (;;)
+	{
+		honk_slot_t* slot = find_slot(reader, chunk);
+
+		if ((slot != NULL) && (slot->state == HONK_SLOT_STATE_READY))
+		{
+			slot->last_use = ++reader->tick;
+			reader->stats.hits++;
+
+			return slot;
+		}
+
+		//Somebody else is decoding the chunk (or all slots are busy), so we wait for them:
+		honk_slot_t* victim = (slot == NULL) ? pick_victim(reader) : NULL;
+
+		if (victim == NULL)
+		{
+			pthread_cond_wait(&reader->slot_ready, &reader->lock);
+			continue;
+		}
+
+		//Decode the chunk into the victim without holding the lock:
+		victim->state = HONK_SLOT_STATE_LOADING;
+		victim->chunk = chunk;
+
+		pthread_mutex_unlock(&reader->lock);
+
+		bool is_loaded = load_chunk(reader, chunk, victim);
+		int load_errno = errno;
+
+		pthread_mutex_lock(&reader->lock);
+
+		victim->state = is_loaded ? HONK_SLOT_STATE_READY : HONK_SLOT_STATE_EMPTY;
+		victim->count = (size_t)(honk_index_uncompressed_end(&reader->index, chunk) - reader->index.entries[chunk].uncompressed_offset);
+		victim->last_use = ++reader->tick;
+		reader->stats.loads++;
+		pthread_cond_broadcast(&reader->slot_ready);
+
+		if (!is_loaded)
+		{
+			errno = load_errno;
+			return NULL;
+		}
+
+		return victim;
+	}
+}
+
+static void* run_prefetch(void* context)
+{
+	honk_reader_t* reader = context;
+
+	pthread_mutex_lock(&reader->lock);
+
+	for (;;)
+	{
+		while ((reader->prefetch_chunk == NO_CHUNK) && !reader->is_closing)
+		{
+			pthread_cond_wait(&reader->prefetch_requested, &reader->lock);
+		}
+
+		if (reader->is_closing)
+		{
+			break;
+		}
+
+		size_t chunk = reader->prefetch_chunk;
+		reader->prefetch_chunk = NO_CHUNK;
+
+		//Skip chunks that are cached already, and never wait for a slot:
+		honk_slot_t* victim = (find_slot(reader, chunk) == NULL) ? pick_victim(reader) : NULL;
+
+		if (victim == NULL)
+		{
+			continue;
+		}
+
+		victim->state = HONK_SLOT_STATE_LOADING;
+		victim->chunk = chunk;
+
+		pthread_mutex_unlock(&reader->lock);
+		bool is_loaded = load_chunk(reader, chunk, victim);
+		pthread_mutex_lock(&reader->lock);
+
+		//A prefetched chunk counts as used right now, so it is not the next victim:
+		victim->state = is_loaded ? HONK_SLOT_STATE_READY : HONK_SLOT_STATE_EMPTY;
+		victim->count = (size_t)(honk_index_uncompressed_end(&reader->index, chunk) - reader->index.entries[chunk].uncompressed_offset);
+		victim->last_use = ++reader->tick;
+		reader->stats.prefetches += is_loaded ? 1 : 0;
+		pthread_cond_broadcast(&reader->slot_ready);
+	}
+
+	pthread_mutex_unlock(&reader->lock);
+
+	return NULL;
+}
+
+static honk_reader_t* open_with_index(int fd, uint64_t container_offset, honk_index_t* index, size_t cache_size)
+{
+	honk_reader_t* reader = calloc(1, sizeof(honk_reader_t));
+
+	if (reader == NULL)
+	{
+		honk_index_destroy(index);
+		errno = ENOMEM;
+
+		return NULL;
+	}
+
+	reader->fd = fd;
+	reader->owns_fd = false;
+	reader->container_offset = container_offset;
+	reader->index = *index;
+	reader->last_chunk = NO_CHUNK;
+	reader->prefetch_chunk = NO_CHUNK;
+
+	//One slot is needed for the chunk we are reading, one for the chunk that is prefetched:
+	reader->slots_count = (cache_size < 2) ? 2 : cache_size;
+	reader->slots = calloc(reader->slots_count, sizeof(honk_slot_t));
+
+	//The slots are sized for the chunks that are actually there (larger ones than the header allows are rejected while loading):
+	uint64_t max_uncompressed_size = honk_index_max_uncompressed_size(&reader->index);
+	uint64_t max_compressed_size = honk_index_max_compressed_size(&reader->index);
+
+	if (max_uncompressed_size > reader->index.header.chunk_size)
+	{
+		max_uncompressed_size = reader->index.header.chunk_size;
+	}
+
+	bool is_allocated = (reader->slots != NULL) && (max_compressed_size < SIZE_MAX);
+
+	for (size_t i = 0; is_allocated && (i < reader->slots_count); i++)
+	{
+		reader->slots[i].data = malloc((size_t)max_uncompressed_size + 1);
+		reader->slots[i].frame = malloc((size_t)max_compressed_size + 1);
+		is_allocated = (reader->slots[i].data != NULL) && (reader->slots[i].frame != NULL);
+	}
+
+	if (!is_allocated)
+	{
+		for (size_t i = 0; (reader->slots != NULL) && (i < reader->slots_count); i++)
+		{
+			free(reader->slots[i].data);
+			free(reader->slots[i].frame);
+		}
+
+		free(reader->slots);
+		honk_index_destroy(&reader->index);
+		free(reader);
+		errno = ENOMEM;
+
+		return NULL;
+	}
+
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->slot_ready, NULL);
+	pthread_cond_init(&reader->prefetch_requested, NULL);
+
+	if (pthread_create(&reader->prefetch_thread, NULL, run_prefetch, reader) != 0)
+	{
+		reader->is_closing = true;
+		honk_reader_close(reader);
+		errno = EAGAIN;
+
+		return NULL;
+	}
+
+	return reader;
+}
+
+honk_reader_t* honk_reader_open(const char* path, size_t cache_size)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	//Legacy streams have their chunk table in a sidecar next to them:
+	honk_index_t index;
+	bool is_indexed = honk_index_load(&index, fd, 0);
+
+	if (!is_indexed)
+	{
+		size_t path_length = strlen(path);
+		char* sidecar_path = malloc(path_length + sizeof(HONK_SIDECAR_SUFFIX));
+		int sidecar_fd = -1;
+
+		if (sidecar_path != NULL)
+		{
+			memcpy(sidecar_path, path, path_length);
+			memcpy(sidecar_path + path_length, HONK_SIDECAR_SUFFIX, sizeof(HONK_SIDECAR_SUFFIX));
+			sidecar_fd = open(sidecar_path, O_RDONLY);
+			free(sidecar_path);
+		}
+
+		if (sidecar_fd >= 0)
+		{
+			is_indexed = honk_index_load_sidecar(&index, sidecar_fd, fd, 0);
+			close(sidecar_fd);
+		}
+	}
+
+	honk_reader_t* reader = is_indexed ? open_with_index(fd, 0, &index, cache_size) : NULL;
+
+	if (reader == NULL)
+	{
+		int open_errno = is_indexed ? errno : EBADMSG;
+		close(fd);
+		errno = open_errno;
+
+		return NULL;
+	}
+
+	reader->owns_fd = true;
+	return reader;
+}
+
+honk_reader_t* honk_reader_open_fd(int fd, uint64_t container_offset, size_t cache_size)
+{
+	honk_index_t index;
+
+	if (!honk_index_load(&index, fd, container_offset))
+	{
+		errno = EBADMSG;
+		return NULL;
+	}
+
+	return open_with_index(fd, container_offset, &index, cache_size);
+}
+
+honk_reader_t* honk_reader_open_sidecar(int fd, int sidecar_fd, uint64_t container_offset, size_t cache_size)
+{
+	honk_index_t index;
+
+	if (!honk_index_load_sidecar(&index, sidecar_fd, fd, container_offset))
+	{
+		errno = EBADMSG;
+		return NULL;
+	}
+
+	return open_with_index(fd, container_offset, &index, cache_size);
+}
+
+void honk_reader_close(honk_reader_t* reader)
+{
+	if (!reader->is_closing)
+	{
+		pthread_mutex_lock(&reader->lock);
+		reader->is_closing = true;
+		pthread_cond_broadcast(&reader->prefetch_requested);
+		pthread_mutex_unlock(&reader->lock);
+
+		pthread_join(reader->prefetch_thread, NULL);
+	}
+
+	for (size_t i = 0; i < reader->slots_count; i++)
+	{
+		free(reader->slots[i].data);
+		free(reader->slots[i].frame);
+	}
+
+	if (reader->owns_fd)
+	{
+		close(reader->fd);
+	}
+
+	pthread_cond_destroy(&reader->prefetch_requested);
+	pthread_cond_destroy(&reader->slot_ready);
+	pthread_mutex_destroy(&reader->lock);
+
+	free(reader->slots);
+	honk_index_destroy(&reader->index);
+	free(reader);
+}
+
+uint64_t honk_reader_size(const honk_reader_t* reader)
+{
+	return reader->index.header.total_size;
+}
+
+ssize_t honk_reader_pread(honk_reader_t* reader, void* dst, size_t count, uint64_t offset)
+{
+	uint64_t total_size = reader->index.header.total_size;
+
+	if ((offset >= total_size) || (count == 0) || (reader->index.entries_count == 0))
+	{
+		return 0;
+	}
+
+	if (count > total_size - offset)
+	{
+		count = (size_t)(total_size - offset);
+	}
+
+	if (count > SSIZE_MAX)
+	{
+		count = SSIZE_MAX;
+	}
+
+	//Copy the requested part of every touched chunk:
+	uint8_t* bytes = dst;
+	size_t copied = 0;
+	size_t chunk = honk_index_find(&reader->index, offset);
+
+	pthread_mutex_lock(&reader->lock);
+
+	while (copied < count)
+	{
+		honk_slot_t* slot = acquire_chunk(reader, chunk);
+
+		if (slot == NULL)
+		{
+			pthread_mutex_unlock(&reader->lock);
+			return -1;
+		}
+
+		uint64_t chunk_offset = offset + copied - reader->index.entries[chunk].uncompressed_offset;
+		size_t chunk_count = slot->count - (size_t)chunk_offset;
+
+		if (chunk_count > count - copied)
+		{
+			chunk_count = count - copied;
+		}
+
+		memcpy(bytes + copied, slot->data + chunk_offset, chunk_count);
+		copied += chunk_count;
+
+		//Two reads in the same or in adjacent chunks look sequential, so we decode the next chunk ahead:
+		bool is_sequential = (reader->last_chunk != NO_CHUNK) && ((chunk == reader->last_chunk) || (chunk == reader->last_chunk + 1));
+		reader->last_chunk = chunk;
+
+		if (is_sequential && (chunk + 1 < reader->index.entries_count) && (find_slot(reader, chunk + 1) == NULL))
+		{
+			reader->prefetch_chunk = chunk + 1;
+			pthread_cond_signal(&reader->prefetch_requested);
+		}
+
+		chunk++;
+	}
+
+	pthread_mutex_unlock(&reader->lock);
+
+	return (ssize_t)copied;
+}
+
+void honk_reader_get_stats(honk_reader_t* reader, honk_reader_stats_t* stats)
+{
+	pthread_mutex_lock(&reader->lock);
+	*stats = reader->stats;
+	pthread_mutex_unlock(&reader->lock);
+}
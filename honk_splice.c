@@ -0,0 +1,232 @@
+//vmsplice() and the pipe size controls are Linux extensions:
+#define _GNU_SOURCE
+
+#include "honk_splice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "honk_io.h"
+
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+typedef struct __honk_block_t__
+{
+	uint8_t* data;
+
+	//Number of bytes spliced into the pipe up to the end of this block (when it is spliced):
+	uint64_t spliced_end;
+	bool is_spliced;
+} honk_block_t;
+
+struct __honk_splice_writer_t__
+{
+	int fd;
+	size_t block_size;
+	size_t pipe_size;
+
+	//Number of bytes passed to the pipe so far:
+	uint64_t written_count;
+
+	//Set once vmsplice() has failed, so we copy from then on:
+	bool is_copying;
+
+	//All blocks live in one anonymous mapping. Each is followed by a page for the slack.
+	void* pool;
+	size_t pool_size;
+	size_t current;
+	size_t blocks_count;
+	honk_block_t blocks[];
+};
+
+//Map the bytes into the pipe (or copy them if vmsplice() does not work):
+static void splice_bytes(honk_splice_writer_t* writer, uint8_t* data, size_t count);
+
+//Has the pipe passed the block on (if it ever got it), given that written_count bytes will have been written?
+static bool is_block_free(const honk_splice_writer_t* writer, const honk_block_t* block, uint64_t written_count);
+
+static void splice_bytes(honk_splice_writer_t* writer, uint8_t* data, size_t count)
+{
+	while ((count > 0) && !writer->is_copying)
+	{
+		struct iovec iov = { data, count };
+		//No SPLICE_F_GIFT: the blocks are filled again, and gifted pages must not be touched any more.
+		ssize_t bytes_count = vmsplice(writer->fd, &iov, 1, 0);
+
+		if (bytes_count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			//write() reports real errors:
+			writer->is_copying = true;
+			break;
+		}
+
+		data += bytes_count;
+		count -= (size_t)bytes_count;
+	}
+
+	honk_io_write_full(writer->fd, data, count);
+}
+
+static bool is_block_free(const honk_splice_writer_t* writer, const honk_block_t* block, uint64_t written_count)
+{
+	//The pipe holds no more than pipe_size bytes, so everything in front of them has been read:
+	return !block->is_spliced || (written_count - block->spliced_end >= writer->pipe_size);
+}
+
+honk_splice_writer_t* honk_splice_writer_create(int fd, size_t block_size)
+{
+	struct stat stat_buf;
+
+	if ((fstat(fd, &stat_buf) != 0) || !S_ISFIFO(stat_buf.st_mode))
+	{
+		return NULL;
+	}
+
+	//The pipe refers to whole pages, so the blocks do not share any:
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	block_size = (block_size + page_size - 1) / page_size * page_size;
+
+	//Let a whole block fit into the pipe (this fails silently above the system limit):
+	int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+
+	if ((pipe_size > 0) && ((size_t)pipe_size < block_size))
+	{
+		fcntl(fd, F_SETPIPE_SZ, (int)block_size);
+		pipe_size = fcntl(fd, F_GETPIPE_SZ);
+	}
+
+	if (pipe_size <= 0)
+	{
+		return NULL;
+	}
+
+	//A full block can be reused after a pipe full of bytes has followed it, plus one block to fill:
+	size_t blocks_count = (size_t)pipe_size / block_size + 2;
+	honk_splice_writer_t* writer = malloc(sizeof(honk_splice_writer_t) + blocks_count * sizeof(honk_block_t));
+
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+
+	//Pages that are still in the pipe stay intact after munmap(), so the pool is mapped instead of allocated:
+	size_t stride = block_size + page_size;
+
+	writer->pool_size = blocks_count * stride;
+	writer->pool = mmap(NULL, writer->pool_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (writer->pool == MAP_FAILED)
+	{
+		free(writer);
+		return NULL;
+	}
+
+	writer->fd = fd;
+	writer->block_size = block_size;
+	writer->pipe_size = (size_t)pipe_size;
+	writer->written_count = 0;
+	writer->is_copying = false;
+	writer->current = 0;
+	writer->blocks_count = blocks_count;
+
+	for (size_t i = 0; i < blocks_count; i++)
+	{
+		writer->blocks[i] = (honk_block_t){ (uint8_t*)writer->pool + i * stride, 0, false };
+	}
+
+	return writer;
+}
+
+uint8_t* honk_splice_writer_block(honk_splice_writer_t* writer)
+{
+	return writer->blocks[writer->current].data;
+}
+
+size_t honk_splice_writer_block_size(const honk_splice_writer_t* writer)
+{
+	return writer->block_size;
+}
+
+uint8_t* honk_splice_writer_submit(honk_splice_writer_t* writer, uint8_t* data, size_t count)
+{
+	if (count == 0)
+	{
+		return data;
+	}
+
+	honk_block_t* block = &writer->blocks[writer->current];
+	size_t next = (writer->current + 1) % writer->blocks_count;
+	uint64_t written_count = writer->written_count + count;
+
+	//Short blocks may leave the next one in the pipe still. Then we copy this block and fill it again.
+	if (!is_block_free(writer, &writer->blocks[next], written_count))
+	{
+		honk_io_write_full(writer->fd, data, count);
+		writer->written_count = written_count;
+
+		return data;
+	}
+
+	splice_bytes(writer, data, count);
+	writer->written_count = written_count;
+
+	block->spliced_end = written_count;
+	block->is_spliced = true;
+	writer->current = next;
+
+	return writer->blocks[next].data;
+}
+
+void honk_splice_writer_destroy(honk_splice_writer_t* writer, uint8_t* data, size_t count)
+{
+	splice_bytes(writer, data, count);
+
+	munmap(writer->pool, writer->pool_size);
+	free(writer);
+}
+
+#else
+
+honk_splice_writer_t* honk_splice_writer_create(int fd, size_t block_size)
+{
+	(void)fd; (void)block_size;
+	return NULL;
+}
+
+uint8_t* honk_splice_writer_block(honk_splice_writer_t* writer)
+{
+	(void)writer;
+	return NULL;
+}
+
+size_t honk_splice_writer_block_size(const honk_splice_writer_t* writer)
+{
+	(void)writer;
+	return 0;
+}
+
+uint8_t* honk_splice_writer_submit(honk_splice_writer_t* writer, uint8_t* data, size_t count)
+{
+	(void)writer; (void)count;
+	return data;
+}
+
+void honk_splice_writer_destroy(honk_splice_writer_t* writer, uint8_t* data, size_t count)
+{
+	(void)writer; (void)data; (void)count;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __HONK_SPLICE_H__
+#define __HONK_SPLICE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Maps the output pages into a pipe with vmsplice() instead of copying them with write().
+//The writer owns a pool of page-aligned blocks. A block is only filled again once the pipe provably has passed it on,
+//i.e. once more than a pipe full of bytes has been spliced behind it. Consumers must read() from the pipe for that to hold
+//(a consumer that splices the pages on, e.g. into another pipe, could still see them change).
+typedef struct __honk_splice_writer_t__ honk_splice_writer_t;
+
+//Start writing to a pipe in blocks of block_size bytes.
+//Returns NULL if vmsplice() is unavailable or the file descriptor is no pipe, so the caller can fall back to write().
+honk_splice_writer_t* honk_splice_writer_create(int fd, size_t block_size);
+
+//Get the block to fill first. It has HONK_IO_SLACK accessible bytes behind its block size.
+uint8_t* honk_splice_writer_block(honk_splice_writer_t* writer);
+
+//Get the size of the blocks (the requested one, rounded up to the page size):
+size_t honk_splice_writer_block_size(const honk_splice_writer_t* writer);
+
+//Pass count bytes of the given block to the pipe and get the next block to fill (which may be the same one):
+uint8_t* honk_splice_writer_submit(honk_splice_writer_t* writer, uint8_t* block, size_t count);
+
+//Pass the last count bytes of the given block to the pipe and release the writer:
+void honk_splice_writer_destroy(honk_splice_writer_t* writer, uint8_t* block, size_t count);
+
+#endif
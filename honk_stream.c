@@ -0,0 +1,594 @@
+#include "honk.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "honk_codec.h"
+#include "honk_container.h"
+#include "honk_io.h"
+
+//The encoder is fed this many bytes at a time, so the tokens they complete always fit into the pending buffer:
+#define SLICE_SIZE ((size_t)1024)
+
+//Room for the tokens of a slice and of the pending block in front of it (a pending run is shorter):
+#define PENDING_SIZE (HONK_MAX_LONG_BLOCK + SLICE_SIZE + (HONK_MAX_LONG_BLOCK + SLICE_SIZE) / 3 + 16)
+
+//The input of the calls that only hand out pending output (memcpy() wants a valid pointer even for 0 bytes):
+static const uint8_t no_input[1] = { 0 };
+
+typedef enum __honk_stream_phase_t__
+{
+	//Collecting the first bytes, which tell a v2 container from a legacy stream:
+	HONK_STREAM_PHASE_START,
+
+	//Decoding the first bytes of a legacy stream (they have been collected already):
+	HONK_STREAM_PHASE_REPLAY,
+
+	HONK_STREAM_PHASE_HEADER,
+	HONK_STREAM_PHASE_CHUNK_HEADER,
+	HONK_STREAM_PHASE_TOKENS,
+	HONK_STREAM_PHASE_STORED,
+
+	//The chunk table and the footer of a v2 container, which are not needed to decode it:
+	HONK_STREAM_PHASE_TRAILER
+} honk_stream_phase_t;
+
+struct __honk_stream_t__
+{
+	honk_stream_mode_t mode;
+
+	//The first error, which every later call returns (0 while there is none):
+	int64_t error;
+
+	//Compression: the encoder writes its tokens into the pending buffer, from where they are handed out.
+	//last_byte is the last byte that has been fed to the encoder, so the next input can start anywhere.
+	honk_encoder_t encoder;
+	honk_output_t pending;
+	size_t pending_pos;
+	uint8_t last_byte;
+	bool is_finished;
+	uint8_t pending_data[PENDING_SIZE];
+
+	//Decompression: the container header, a chunk header or the first bytes of the stream are collected in header[]:
+	honk_stream_phase_t phase;
+	uint8_t header[HONK_V2_HEADER_SIZE];
+	size_t header_count;
+	size_t replay_pos;
+
+	//The container and the current chunk (a legacy stream is an unframed chunk of unlimited size):
+	bool is_framed;
+	bool is_wide;
+	uint64_t total_size;
+	uint64_t total_count;
+	uint64_t chunk_remaining;
+	uint64_t chunk_size;
+	uint64_t chunk_count;
+
+	//The token in progress: its remaining bytes, or the first bytes of a token that is cut off in front of its content:
+	bool is_rle;
+	uint8_t run_byte;
+	size_t token_remaining;
+	uint8_t token_header[HONK_MAX_TOKEN_HEADER_SIZE + 1];
+	size_t token_header_count;
+};
+
+//Hand out as many pending tokens as fit:
+static void drain_pending(honk_stream_t* stream, uint8_t* out, size_t out_capacity, size_t* out_count);
+
+//Encode the input as far as the output takes the tokens:
+static void compress_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, uint8_t* out, size_t out_capacity, size_t* out_count);
+
+//Move to the token of the given header (header points at its start):
+static void begin_token(honk_stream_t* stream, const honk_token_t* token, const uint8_t* header);
+
+//Begin the staged token once its header is complete. Returns false if it is invalid.
+static bool begin_staged_token(honk_stream_t* stream);
+
+//Is a token in progress?
+static bool is_in_token(const honk_stream_t* stream);
+
+//Decode the tokens in the input as far as the output takes them. Returns the number of consumed bytes.
+static size_t decode_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, uint8_t* out, size_t out_capacity, size_t* out_count);
+
+//Collect up to size bytes into header[]. Returns true once they are there.
+static bool collect_header(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, size_t size);
+
+//Take the next chunk header (or the end of chunks):
+static void begin_chunk(honk_stream_t* stream);
+
+//Run the phases of the decoder as far as the input and the output allow:
+static void decompress_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, uint8_t* out, size_t out_capacity, size_t* out_count);
+
+static void drain_pending(honk_stream_t* stream, uint8_t* out, size_t out_capacity, size_t* out_count)
+{
+	size_t count = stream->pending.count - stream->pending_pos;
+	count = (count < out_capacity - *out_count) ? count : (out_capacity - *out_count);
+
+	memcpy(out + *out_count, stream->pending.data + stream->pending_pos, count);
+	*out_count += count;
+	stream->pending_pos += count;
+
+	if (stream->pending_pos == stream->pending.count)
+	{
+		stream->pending.count = 0;
+		stream->pending_pos = 0;
+	}
+}
+
+static void compress_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, uint8_t* out, size_t out_capacity, size_t* out_count)
+{
+	size_t i = *in_pos;
+
+	for (;;)
+	{
+		drain_pending(stream, out, out_capacity, out_count);
+
+		//Only an empty pending buffer is sure to take the tokens of the next slice:
+		if ((stream->pending.count > 0) || (i == in_count))
+		{
+			break;
+		}
+
+		size_t count = (in_count - i < SLICE_SIZE) ? (in_count - i) : SLICE_SIZE;
+		stream->is_finished = false;
+
+		//The encoder looks at the byte in front of the input, which the caller may not have kept:
+		if (i == 0)
+		{
+			uint8_t first[2] = { stream->last_byte, in[0] };
+
+			honk_encoder_update(&stream->encoder, first + 1, 1, &stream->pending);
+			honk_encoder_update(&stream->encoder, in + 1, count - 1, &stream->pending);
+		}
+		else
+		{
+			honk_encoder_update(&stream->encoder, in + i, count, &stream->pending);
+		}
+
+		i += count;
+		stream->last_byte = in[i - 1];
+
+		//The pending buffer is sized for a slice, so this is not supposed to happen:
+		if (stream->pending.is_overflowed)
+		{
+			stream->error = HONK_ERROR_DST_TOO_SMALL;
+			break;
+		}
+	}
+
+	*in_pos = i;
+}
+
+static void begin_token(honk_stream_t* stream, const honk_token_t* token, const uint8_t* header)
+{
+	stream->is_rle = token->is_rle;
+	stream->token_remaining = token->count;
+
+	if (token->is_rle)
+	{
+		stream->run_byte = header[token->content_offset];
+	}
+}
+
+static bool begin_staged_token(honk_stream_t* stream)
+{
+	honk_token_t token;
+
+	//Status words are never invalid, and a status byte with its length takes up to HONK_MAX_TOKEN_HEADER_SIZE bytes:
+	if (!honk_read_token(stream->token_header, stream->token_header_count, stream->is_wide, &token))
+	{
+		return stream->is_wide || (stream->token_header_count < HONK_MAX_TOKEN_HEADER_SIZE);
+	}
+
+	//A run needs its byte as well:
+	if (stream->token_header_count == token.content_offset + (token.is_rle ? 1 : 0))
+	{
+		begin_token(stream, &token, stream->token_header);
+		stream->token_header_count = 0;
+	}
+
+	return true;
+}
+
+static bool is_in_token(const honk_stream_t* stream)
+{
+	return (stream->token_remaining > 0) || (stream->token_header_count > 0);
+}
+
+static size_t decode_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, uint8_t* out, size_t out_capacity, size_t* out_count)
+{
+	size_t i = 0;
+
+	for (;;)
+	{
+		//Go on with the token in progress (which may be a long run that takes many calls):
+		if (stream->token_remaining > 0)
+		{
+			size_t count = (stream->token_remaining < out_capacity - *out_count) ? stream->token_remaining : (out_capacity - *out_count);
+
+			if (!stream->is_rle)
+			{
+				count = (count < in_count - i) ? count : (in_count - i);
+			}
+
+			if (count == 0)
+			{
+				break;
+			}
+
+			if (stream->is_rle)
+			{
+				memset(out + *out_count, stream->run_byte, count);
+			}
+			else
+			{
+				memcpy(out + *out_count, in + i, count);
+				i += count;
+			}
+
+			*out_count += count;
+			stream->token_remaining -= count;
+
+			continue;
+		}
+
+		if (i == in_count)
+		{
+			break;
+		}
+
+		//Complete the header of a token that is cut off, a byte at a time:
+		if (stream->token_header_count > 0)
+		{
+			stream->token_header[stream->token_header_count++] = in[i++];
+
+			if (!begin_staged_token(stream))
+			{
+				stream->error = HONK_ERROR_BAD_FORMAT;
+				break;
+			}
+
+			continue;
+		}
+
+		//Decode the complete tokens that fit as a whole:
+		i += honk_decode_tokens(in + i, in_count - i, out, out_capacity, out_count, stream->is_wide);
+
+		if (i == in_count)
+		{
+			break;
+		}
+
+		//Then begin the token that does not fit or is cut off:
+		honk_token_t token;
+		size_t available = in_count - i;
+
+		if (honk_read_token(in + i, available, stream->is_wide, &token) && (available >= token.content_offset + (token.is_rle ? 1 : 0)))
+		{
+			begin_token(stream, &token, in + i);
+			i += token.content_offset + (token.is_rle ? 1 : 0);
+
+			continue;
+		}
+
+		if (!stream->is_wide && (available >= HONK_MAX_TOKEN_HEADER_SIZE))
+		{
+			stream->error = HONK_ERROR_BAD_FORMAT;
+			break;
+		}
+
+		//The header is cut off, so the rest of the input is part of it:
+		memcpy(stream->token_header, in + i, available);
+		stream->token_header_count = available;
+		i = in_count;
+
+		break;
+	}
+
+	return i;
+}
+
+static bool collect_header(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, size_t size)
+{
+	size_t count = (size - stream->header_count < in_count - *in_pos) ? (size - stream->header_count) : (in_count - *in_pos);
+
+	memcpy(stream->header + stream->header_count, in + *in_pos, count);
+	stream->header_count += count;
+	*in_pos += count;
+
+	return stream->header_count == size;
+}
+
+static void begin_chunk(honk_stream_t* stream)
+{
+	honk_v2_chunk_header_t chunk_header;
+
+	stream->header_count = 0;
+
+	if (!honk_v2_read_chunk_header(stream->header, &chunk_header))
+	{
+		stream->error = HONK_ERROR_BAD_FORMAT;
+		return;
+	}
+
+	//The end of chunks must come with the announced size:
+	if (chunk_header.payload_size == 0)
+	{
+		if ((stream->total_size != HONK_V2_UNKNOWN_SIZE) && (stream->total_size != stream->total_count))
+		{
+			stream->error = HONK_ERROR_BAD_FORMAT;
+		}
+
+		stream->phase = HONK_STREAM_PHASE_TRAILER;
+		return;
+	}
+
+	stream->chunk_remaining = chunk_header.payload_size;
+	stream->chunk_size = chunk_header.uncompressed_size;
+	stream->chunk_count = 0;
+	stream->phase = chunk_header.is_stored ? HONK_STREAM_PHASE_STORED : HONK_STREAM_PHASE_TOKENS;
+}
+
+static void decompress_step(honk_stream_t* stream, const uint8_t* in, size_t in_count, size_t* in_pos, uint8_t* out, size_t out_capacity, size_t* out_count)
+{
+	while (stream->error == 0)
+	{
+		size_t previous_pos = *in_pos;
+		size_t previous_count = *out_count;
+		honk_stream_phase_t previous_phase = stream->phase;
+
+		switch (stream->phase)
+		{
+		case HONK_STREAM_PHASE_START:
+
+			if (collect_header(stream, in, in_count, in_pos, HONK_V2_MAGIC_SIZE))
+			{
+				stream->phase = honk_v2_has_magic(stream->header, HONK_V2_MAGIC_SIZE) ? HONK_STREAM_PHASE_HEADER : HONK_STREAM_PHASE_REPLAY;
+			}
+
+			break;
+
+		case HONK_STREAM_PHASE_REPLAY:
+
+			stream->replay_pos += decode_step(stream, stream->header + stream->replay_pos, stream->header_count - stream->replay_pos, out, out_capacity, out_count);
+
+			if (stream->replay_pos == stream->header_count)
+			{
+				stream->header_count = 0;
+				stream->phase = HONK_STREAM_PHASE_TOKENS;
+			}
+
+			break;
+
+		case HONK_STREAM_PHASE_HEADER:
+		{
+			honk_v2_header_t header;
+
+			if (!collect_header(stream, in, in_count, in_pos, HONK_V2_HEADER_SIZE))
+			{
+				break;
+			}
+
+			if (!honk_v2_read_header(stream->header, &header))
+			{
+				stream->error = HONK_ERROR_BAD_FORMAT;
+				break;
+			}
+
+			stream->header_count = 0;
+			stream->is_framed = true;
+			stream->is_wide = honk_v2_has_wide_tokens(&header);
+			stream->total_size = header.total_size;
+			stream->phase = HONK_STREAM_PHASE_CHUNK_HEADER;
+
+			break;
+		}
+
+		case HONK_STREAM_PHASE_CHUNK_HEADER:
+
+			if (collect_header(stream, in, in_count, in_pos, HONK_V2_CHUNK_HEADER_SIZE))
+			{
+				begin_chunk(stream);
+			}
+
+			break;
+
+		case HONK_STREAM_PHASE_TOKENS:
+		{
+			//The tokens of a chunk must not reach beyond it:
+			size_t count = in_count - *in_pos;
+			count = (count < stream->chunk_remaining) ? count : (size_t)stream->chunk_remaining;
+
+			size_t consumed = decode_step(stream, in + *in_pos, count, out, out_capacity, out_count);
+
+			*in_pos += consumed;
+			stream->chunk_remaining -= consumed;
+			stream->chunk_count += *out_count - previous_count;
+
+			//A chunk ends with its last token (a run may still be expanding) and must decode to its size:
+			if (stream->is_framed && (stream->chunk_remaining == 0) && !(stream->is_rle && (stream->token_remaining > 0)))
+			{
+				if (is_in_token(stream) || (stream->chunk_count != stream->chunk_size))
+				{
+					stream->error = HONK_ERROR_BAD_FORMAT;
+					break;
+				}
+
+				stream->phase = HONK_STREAM_PHASE_CHUNK_HEADER;
+			}
+
+			break;
+		}
+
+		case HONK_STREAM_PHASE_STORED:
+		{
+			size_t count = in_count - *in_pos;
+			count = (count < out_capacity - *out_count) ? count : (out_capacity - *out_count);
+			count = (count < stream->chunk_remaining) ? count : (size_t)stream->chunk_remaining;
+
+			memcpy(out + *out_count, in + *in_pos, count);
+			*in_pos += count;
+			*out_count += count;
+			stream->chunk_remaining -= count;
+
+			if (stream->chunk_remaining == 0)
+			{
+				stream->phase = HONK_STREAM_PHASE_CHUNK_HEADER;
+			}
+
+			break;
+		}
+
+		case HONK_STREAM_PHASE_TRAILER:
+
+			*in_pos = in_count;
+			break;
+		}
+
+		stream->total_count += *out_count - previous_count;
+
+		//Stop once nothing moves anymore:
+		if ((*in_pos == previous_pos) && (*out_count == previous_count) && (stream->phase == previous_phase))
+		{
+			break;
+		}
+	}
+}
+
+honk_stream_t* honk_stream_create(honk_stream_mode_t mode, uint32_t flags)
+{
+	honk_stream_t* stream = malloc(sizeof(honk_stream_t));
+
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	stream->mode = mode;
+	stream->error = 0;
+
+	honk_encoder_init(&stream->encoder, (flags & HONK_FLAG_LONG_TOKENS) ? HONK_LAYOUT_LONG : HONK_LAYOUT_COMPAT);
+	honk_output_init_fixed(&stream->pending, stream->pending_data, PENDING_SIZE);
+	stream->pending_pos = 0;
+	stream->last_byte = 0;
+	stream->is_finished = false;
+
+	stream->phase = HONK_STREAM_PHASE_START;
+	stream->header_count = 0;
+	stream->replay_pos = 0;
+
+	stream->is_framed = false;
+	stream->is_wide = false;
+	stream->total_size = HONK_V2_UNKNOWN_SIZE;
+	stream->total_count = 0;
+	stream->chunk_remaining = UINT64_MAX;
+	stream->chunk_size = 0;
+	stream->chunk_count = 0;
+
+	stream->is_rle = false;
+	stream->run_byte = 0;
+	stream->token_remaining = 0;
+	stream->token_header_count = 0;
+
+	return stream;
+}
+
+void honk_stream_destroy(honk_stream_t* stream)
+{
+	free(stream);
+}
+
+int64_t honk_stream_update(honk_stream_t* stream, const void* in, size_t in_count, size_t* in_consumed, void* out, size_t out_capacity)
+{
+	size_t in_pos = 0;
+	size_t out_count = 0;
+
+	*in_consumed = 0;
+
+	if (stream->error != 0)
+	{
+		return stream->error;
+	}
+
+	//Bound the work of a single call:
+	in_count = (in_count < HONK_STREAM_STEP_SIZE) ? in_count : HONK_STREAM_STEP_SIZE;
+	out_capacity = (out_capacity < HONK_STREAM_STEP_SIZE) ? out_capacity : HONK_STREAM_STEP_SIZE;
+
+	if (stream->mode == HONK_STREAM_COMPRESS)
+	{
+		compress_step(stream, in, in_count, &in_pos, out, out_capacity, &out_count);
+	}
+	else
+	{
+		decompress_step(stream, in, in_count, &in_pos, out, out_capacity, &out_count);
+	}
+
+	if (stream->error != 0)
+	{
+		return stream->error;
+	}
+
+	*in_consumed = in_pos;
+	return (int64_t)out_count;
+}
+
+int64_t honk_stream_finish(honk_stream_t* stream, void* out, size_t out_capacity)
+{
+	size_t in_consumed;
+
+	//A stream that ends within the first bytes is a short legacy stream:
+	if ((stream->mode == HONK_STREAM_DECOMPRESS) && (stream->phase == HONK_STREAM_PHASE_START))
+	{
+		stream->phase = HONK_STREAM_PHASE_REPLAY;
+	}
+
+	//Hand out what is still pending:
+	int64_t count = honk_stream_update(stream, no_input, 0, &in_consumed, out, out_capacity);
+
+	if (count != 0)
+	{
+		return count;
+	}
+
+	if (stream->mode == HONK_STREAM_COMPRESS)
+	{
+		if (stream->pending.count > 0)
+		{
+			return HONK_ERROR_DST_TOO_SMALL;
+		}
+
+		//Write the pending run or block once:
+		if (!stream->is_finished)
+		{
+			honk_encoder_finish(&stream->encoder, &stream->pending);
+			stream->is_finished = true;
+
+			if (stream->pending.is_overflowed)
+			{
+				stream->error = HONK_ERROR_DST_TOO_SMALL;
+			}
+
+			return honk_stream_update(stream, no_input, 0, &in_consumed, out, out_capacity);
+		}
+
+		return 0;
+	}
+
+	//Nothing moves anymore, so the output is full or the input ends too early (collected first bytes are only left over on a full output):
+	if ((stream->phase == HONK_STREAM_PHASE_REPLAY) || (stream->is_rle && (stream->token_remaining > 0)))
+	{
+		return HONK_ERROR_DST_TOO_SMALL;
+	}
+
+	bool is_at_tail = (stream->token_remaining == 0) && honk_is_stream_tail(stream->token_header, stream->token_header_count, stream->is_wide);
+	bool is_complete = (stream->phase == HONK_STREAM_PHASE_TRAILER) || (!stream->is_framed && (stream->phase == HONK_STREAM_PHASE_TOKENS) && is_at_tail);
+
+	if (!is_complete)
+	{
+		stream->error = HONK_ERROR_BAD_FORMAT;
+		return stream->error;
+	}
+
+	return 0;
+}
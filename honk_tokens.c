@@ -0,0 +1,168 @@
+#include "honk.h"
+
+#include "honk_codec.h"
+#include "honk_container.h"
+
+//Stop the iterator at broken input:
+static int64_t fail(honk_token_iterator_t* iterator);
+
+//Move into the next chunk of a container (or to its end). Returns a stored chunk as a literal.
+//Returns 1 if the token has been set, 0 if the tokens of the chunk follow or the container has ended, or an error.
+static int64_t next_chunk(honk_token_iterator_t* iterator, honk_token_view_t* token);
+
+static int64_t fail(honk_token_iterator_t* iterator)
+{
+	iterator->error = HONK_ERROR_BAD_FORMAT;
+	return iterator->error;
+}
+
+static int64_t next_chunk(honk_token_iterator_t* iterator, honk_token_view_t* token)
+{
+	honk_v2_chunk_header_t chunk_header;
+
+	//The tokens of the previous chunk must have decoded to its size:
+	if (iterator->chunk_count != iterator->chunk_size)
+	{
+		return fail(iterator);
+	}
+
+	if ((iterator->input_count - iterator->pos < HONK_V2_CHUNK_HEADER_SIZE) || !honk_v2_read_chunk_header(iterator->input + iterator->pos, &chunk_header))
+	{
+		return fail(iterator);
+	}
+
+	iterator->pos += HONK_V2_CHUNK_HEADER_SIZE;
+
+	//The end of chunks must come with the announced size (the chunk table and the footer behind it are not needed):
+	if (chunk_header.payload_size == 0)
+	{
+		if ((iterator->total_size != HONK_V2_UNKNOWN_SIZE) && (iterator->total_size != iterator->total_count))
+		{
+			return fail(iterator);
+		}
+
+		iterator->is_at_end = true;
+		return 0;
+	}
+
+	if (iterator->input_count - iterator->pos < chunk_header.payload_size)
+	{
+		return fail(iterator);
+	}
+
+	iterator->chunk_end = iterator->pos + chunk_header.payload_size;
+	iterator->chunk_size = chunk_header.uncompressed_size;
+	iterator->chunk_count = 0;
+
+	if (!chunk_header.is_stored)
+	{
+		return 0;
+	}
+
+	//A stored chunk is a single literal:
+	token->is_run = false;
+	token->byte = 0;
+	token->bytes = iterator->input + iterator->pos;
+	token->count = chunk_header.payload_size;
+
+	iterator->pos = iterator->chunk_end;
+	iterator->chunk_count = chunk_header.payload_size;
+	iterator->total_count += chunk_header.payload_size;
+
+	return 1;
+}
+
+void honk_token_iterator_init(honk_token_iterator_t* iterator, const void* src, size_t src_count)
+{
+	iterator->input = src;
+	iterator->input_count = src_count;
+	iterator->pos = 0;
+	iterator->chunk_end = src_count;
+	iterator->chunk_size = 0;
+	iterator->chunk_count = 0;
+	iterator->is_framed = false;
+	iterator->is_wide = false;
+	iterator->is_at_end = false;
+	iterator->total_size = HONK_V2_UNKNOWN_SIZE;
+	iterator->total_count = 0;
+	iterator->error = 0;
+
+	//V2 container or legacy stream?
+	if (!honk_v2_has_magic(iterator->input, src_count))
+	{
+		return;
+	}
+
+	honk_v2_header_t header;
+
+	if ((src_count < HONK_V2_HEADER_SIZE) || !honk_v2_read_header(iterator->input, &header))
+	{
+		fail(iterator);
+		return;
+	}
+
+	//The first chunk header follows right away:
+	iterator->pos = HONK_V2_HEADER_SIZE;
+	iterator->chunk_end = HONK_V2_HEADER_SIZE;
+	iterator->is_framed = true;
+	iterator->is_wide = honk_v2_has_wide_tokens(&header);
+	iterator->total_size = header.total_size;
+}
+
+int64_t honk_token_iterator_next(honk_token_iterator_t* iterator, honk_token_view_t* token)
+{
+	while ((iterator->error == 0) && !iterator->is_at_end)
+	{
+		if (iterator->pos == iterator->chunk_end)
+		{
+			if (!iterator->is_framed)
+			{
+				iterator->is_at_end = true;
+				break;
+			}
+
+			int64_t result = next_chunk(iterator, token);
+
+			if (result != 0)
+			{
+				return result;
+			}
+
+			continue;
+		}
+
+		//The token must be complete and within its chunk:
+		honk_token_t found;
+		size_t available = iterator->chunk_end - iterator->pos;
+		const uint8_t* input = iterator->input + iterator->pos;
+
+		if (!iterator->is_framed && honk_is_stream_tail(input, available, iterator->is_wide))
+		{
+			iterator->is_at_end = true;
+			break;
+		}
+
+		if (!honk_read_token(input, available, iterator->is_wide, &found) || (available < found.size))
+		{
+			return fail(iterator);
+		}
+
+		iterator->pos += found.size;
+		iterator->chunk_count += found.count;
+		iterator->total_count += found.count;
+
+		if (found.count == 0)
+		{
+			continue;
+		}
+
+		token->is_run = found.is_rle;
+		token->byte = found.is_rle ? input[found.content_offset] : 0;
+		token->bytes = input + found.content_offset;
+		token->count = found.count;
+
+		return 1;
+	}
+
+	return iterator->error;
+}
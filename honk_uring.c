@@ -0,0 +1,669 @@
+//O_DIRECT is a Linux extension:
+#define _GNU_SOURCE
+
+#include "honk_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "honk_io.h"
+
+//io_uring is driven through raw system calls, so there is no need for liburing:
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HONK_HAVE_URING
+#endif
+#endif
+
+#ifdef HONK_HAVE_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+//The submission and completion queues, shared with the kernel:
+typedef struct __honk_ring_t__
+{
+	int fd;
+
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned* sq_array;
+	struct io_uring_sqe* sqes;
+
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe* cqes;
+
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+} honk_ring_t;
+
+typedef enum __honk_block_state_t__
+{
+	HONK_BLOCK_STATE_IDLE,
+	HONK_BLOCK_STATE_BUSY,
+	HONK_BLOCK_STATE_READY
+} honk_block_state_t;
+
+typedef struct __honk_block_t__
+{
+	uint8_t* data;
+	honk_block_state_t state;
+
+	//File offset and size of the read or write:
+	uint64_t offset;
+	size_t size;
+
+	//Read blocks: Number of read bytes and how many of them are consumed.
+	size_t count;
+	size_t pos;
+} honk_block_t;
+
+struct __honk_uring_reader_t__
+{
+	honk_ring_t ring;
+	int fd;
+	size_t block_size;
+	bool is_direct;
+
+	//The ring goes through a private O_DIRECT descriptor of the file (or through fd), so the flags of the caller stay as they are:
+	int ring_fd;
+
+	honk_block_t blocks[HONK_URING_DEPTH];
+	size_t current;
+
+	uint64_t file_size;
+	uint64_t next_offset;
+	uint64_t consumed_offset;
+};
+
+struct __honk_uring_writer_t__
+{
+	honk_ring_t ring;
+	int fd;
+	size_t block_size;
+	bool is_direct;
+
+	//The ring goes through a private O_DIRECT descriptor of the file (or through fd), so the flags of the caller stay as they are:
+	int ring_fd;
+
+	honk_block_t blocks[HONK_URING_DEPTH];
+	uint64_t next_offset;
+};
+
+//Set up a ring with the given number of entries. Returns false if io_uring is unavailable.
+static bool ring_init(honk_ring_t* ring, unsigned entries);
+
+//Tear down a ring:
+static void ring_exit(honk_ring_t* ring);
+
+//Submit a single read or write:
+static void ring_submit(honk_ring_t* ring, uint8_t opcode, int fd, uint8_t* data, size_t size, uint64_t offset, uint64_t user_data);
+
+//Wait for the next completion and return its result:
+static int ring_wait(honk_ring_t* ring, uint64_t* user_data);
+
+//Allocate the blocks (aligned for O_DIRECT, with HONK_IO_SLACK accessible bytes behind them):
+static bool alloc_blocks(honk_block_t* blocks, size_t block_size);
+
+//Release the blocks:
+static void free_blocks(honk_block_t* blocks);
+
+//Open the file of a descriptor once more with O_DIRECT, for transfers from the given offset on.
+//Returns -1 if the file does not support it.
+static int open_direct(int fd, int flags, off_t offset);
+
+//Read the next block of the file into the given block (or leave it idle at the end of the file):
+static void submit_read(honk_uring_reader_t* reader, honk_block_t* block);
+
+//Wait for the next read and complete its block:
+static void complete_read(honk_uring_reader_t* reader);
+
+//Wait for the next write and give its block free:
+static void complete_write(honk_uring_writer_t* writer);
+
+static bool ring_init(honk_ring_t* ring, unsigned entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+	if (ring->fd < 0)
+	{
+		return false;
+	}
+
+	//Map the queues. Newer kernels put both rings into one mapping:
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	bool is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+	if (is_single_mmap)
+	{
+		ring->sq_ring_size = (ring->cq_ring_size > ring->sq_ring_size) ? ring->cq_ring_size : ring->sq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = is_single_mmap ? ring->sq_ring : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if ((ring->sq_ring == MAP_FAILED) || (ring->cq_ring == MAP_FAILED) || (ring->sqes == MAP_FAILED))
+	{
+		if (ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+		if (!is_single_mmap && (ring->cq_ring != MAP_FAILED)) munmap(ring->cq_ring, ring->cq_ring_size);
+		if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+		close(ring->fd);
+
+		return false;
+	}
+
+	uint8_t* sq_ring = ring->sq_ring;
+	uint8_t* cq_ring = ring->cq_ring;
+
+	ring->sq_head = (unsigned*)(sq_ring + params.sq_off.head);
+	ring->sq_tail = (unsigned*)(sq_ring + params.sq_off.tail);
+	ring->sq_mask = *(unsigned*)(sq_ring + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->sq_array = (unsigned*)(sq_ring + params.sq_off.array);
+
+	ring->cq_head = (unsigned*)(cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq_ring + params.cq_off.tail);
+	ring->cq_mask = *(unsigned*)(cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+
+	return true;
+}
+
+static void ring_exit(honk_ring_t* ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+
+	if (ring->cq_ring != ring->sq_ring)
+	{
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+}
+
+static void ring_submit(honk_ring_t* ring, uint8_t opcode, int fd, uint8_t* data, size_t size, uint64_t offset, uint64_t user_data)
+{
+	//There are never more requests in flight than entries, so the queue cannot be full:
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = (uint32_t)size;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	//Hand it to the kernel right away:
+	int result;
+
+	do
+	{
+		result = (int)syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	}
+	while ((result < 0) && (errno == EINTR));
+
+	if (result < 0)
+	{
+		fprintf(stderr, "Error while submitting asynchronous I/O.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static int ring_wait(honk_ring_t* ring, uint64_t* user_data)
+{
+	for (;;)
+	{
+		unsigned head = *ring->cq_head;
+
+		if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+
+			*user_data = cqe->user_data;
+			int result = cqe->res;
+
+			__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+			return result;
+		}
+
+		if ((syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR))
+		{
+			fprintf(stderr, "Error while waiting for asynchronous I/O.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static bool alloc_blocks(honk_block_t* blocks, size_t block_size)
+{
+	memset(blocks, 0, HONK_URING_DEPTH * sizeof(honk_block_t));
+
+	for (size_t i = 0; i < HONK_URING_DEPTH; i++)
+	{
+		void* data;
+
+		if (posix_memalign(&data, HONK_URING_ALIGNMENT, block_size + HONK_URING_ALIGNMENT) != 0)
+		{
+			free_blocks(blocks);
+			return false;
+		}
+
+		blocks[i].data = data;
+	}
+
+	return true;
+}
+
+static void free_blocks(honk_block_t* blocks)
+{
+	for (size_t i = 0; i < HONK_URING_DEPTH; i++)
+	{
+		free(blocks[i].data);
+		blocks[i].data = NULL;
+	}
+}
+
+static int open_direct(int fd, int flags, off_t offset)
+{
+	//O_DIRECT transfers must start at aligned offsets:
+	if (offset % (off_t)HONK_URING_ALIGNMENT != 0)
+	{
+		return -1;
+	}
+
+	//Setting O_DIRECT with fcntl() would change the open file description, which the caller (or the shell) may share:
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+	return open(path, flags | O_DIRECT | O_CLOEXEC);
+}
+
+static void submit_read(honk_uring_reader_t* reader, honk_block_t* block)
+{
+	block->count = 0;
+	block->pos = 0;
+
+	if (reader->next_offset >= reader->file_size)
+	{
+		block->state = HONK_BLOCK_STATE_IDLE;
+		return;
+	}
+
+	//O_DIRECT reads whole blocks and gets a short read at the end of the file:
+	uint64_t remaining = reader->file_size - reader->next_offset;
+
+	block->state = HONK_BLOCK_STATE_BUSY;
+	block->offset = reader->next_offset;
+	block->size = (reader->is_direct || (remaining > reader->block_size)) ? reader->block_size : (size_t)remaining;
+
+	ring_submit(&reader->ring, IORING_OP_READ, reader->ring_fd, block->data, block->size, block->offset, (uint64_t)(block - reader->blocks));
+	reader->next_offset += reader->block_size;
+}
+
+static void complete_read(honk_uring_reader_t* reader)
+{
+	uint64_t index;
+	int result = ring_wait(&reader->ring, &index);
+
+	if (result < 0)
+	{
+		fprintf(stderr, "Error while reading from input file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	honk_block_t* block = &reader->blocks[index];
+	block->count = (size_t)result;
+	block->state = HONK_BLOCK_STATE_READY;
+
+	//Short reads in front of the end of the file are completed synchronously:
+	uint64_t expected = reader->file_size - block->offset;
+	expected = (expected < block->size) ? expected : block->size;
+
+	if (block->count < expected)
+	{
+		block->count += honk_io_pread_full(reader->fd, block->data + block->count, (size_t)expected - block->count, block->offset + block->count);
+	}
+}
+
+static void complete_write(honk_uring_writer_t* writer)
+{
+	uint64_t index;
+	int result = ring_wait(&writer->ring, &index);
+
+	if (result < 0)
+	{
+		fprintf(stderr, "Error while writing to output file descriptor.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Short writes are completed synchronously:
+	honk_block_t* block = &writer->blocks[index];
+
+	if ((size_t)result < block->size)
+	{
+		honk_io_pwrite_full(writer->fd, block->data + result, block->size - (size_t)result, block->offset + (uint64_t)result);
+	}
+
+	block->state = HONK_BLOCK_STATE_IDLE;
+}
+
+honk_uring_reader_t* honk_uring_reader_create(int fd, off_t offset, size_t block_size, bool is_direct)
+{
+	struct stat stat_buf;
+
+	if ((offset < 0) || (fstat(fd, &stat_buf) != 0) || !S_ISREG(stat_buf.st_mode))
+	{
+		return NULL;
+	}
+
+	honk_uring_reader_t* reader = malloc(sizeof(honk_uring_reader_t));
+
+	if (reader == NULL)
+	{
+		return NULL;
+	}
+
+	//The blocks are aligned for O_DIRECT:
+	reader->fd = fd;
+	reader->block_size = (block_size + HONK_URING_ALIGNMENT - 1) / HONK_URING_ALIGNMENT * HONK_URING_ALIGNMENT;
+	reader->current = 0;
+	reader->file_size = (uint64_t)stat_buf.st_size;
+	reader->next_offset = (uint64_t)offset;
+	reader->consumed_offset = (uint64_t)offset;
+
+	if (!ring_init(&reader->ring, HONK_URING_DEPTH))
+	{
+		free(reader);
+		return NULL;
+	}
+
+	if (!alloc_blocks(reader->blocks, reader->block_size))
+	{
+		ring_exit(&reader->ring);
+		free(reader);
+
+		return NULL;
+	}
+
+	int direct_fd = is_direct ? open_direct(fd, O_RDONLY, offset) : -1;
+	reader->is_direct = (direct_fd >= 0);
+	reader->ring_fd = reader->is_direct ? direct_fd : fd;
+
+	//Fill the pipeline:
+	for (size_t i = 0; i < HONK_URING_DEPTH; i++)
+	{
+		submit_read(reader, &reader->blocks[i]);
+	}
+
+	return reader;
+}
+
+void honk_uring_reader_destroy(honk_uring_reader_t* reader)
+{
+	//The kernel must be done with the blocks before we release them:
+	for (size_t i = 0; i < HONK_URING_DEPTH; i++)
+	{
+		while (reader->blocks[i].state == HONK_BLOCK_STATE_BUSY)
+		{
+			complete_read(reader);
+		}
+	}
+
+	if (reader->is_direct)
+	{
+		close(reader->ring_fd);
+	}
+
+	lseek(reader->fd, (off_t)reader->consumed_offset, SEEK_SET);
+
+	free_blocks(reader->blocks);
+	ring_exit(&reader->ring);
+	free(reader);
+}
+
+size_t honk_uring_reader_read(honk_uring_reader_t* reader, uint8_t* dst, size_t size)
+{
+	size_t copied = 0;
+
+	while (copied < size)
+	{
+		honk_block_t* block = &reader->blocks[reader->current];
+
+		//Idle blocks are past the end of the file:
+		if (block->state == HONK_BLOCK_STATE_IDLE)
+		{
+			break;
+		}
+
+		while (block->state == HONK_BLOCK_STATE_BUSY)
+		{
+			complete_read(reader);
+		}
+
+		size_t count = block->count - block->pos;
+		count = (count < size - copied) ? count : (size - copied);
+
+		memcpy(dst + copied, block->data + block->pos, count);
+		block->pos += count;
+		copied += count;
+		reader->consumed_offset += count;
+
+		//A consumed block goes right back to the kernel:
+		if (block->pos == block->count)
+		{
+			submit_read(reader, block);
+			reader->current = (reader->current + 1) % HONK_URING_DEPTH;
+		}
+	}
+
+	return copied;
+}
+
+honk_uring_writer_t* honk_uring_writer_create(int fd, off_t offset, size_t block_size, bool is_direct)
+{
+	struct stat stat_buf;
+
+	if ((offset < 0) || (fstat(fd, &stat_buf) != 0) || !S_ISREG(stat_buf.st_mode))
+	{
+		return NULL;
+	}
+
+	honk_uring_writer_t* writer = malloc(sizeof(honk_uring_writer_t));
+
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+
+	//With O_DIRECT, an unaligned rest of up to one alignment stays in the block after a flush, so there must be room for more:
+	block_size = (block_size < 2 * HONK_URING_ALIGNMENT) ? (2 * HONK_URING_ALIGNMENT) : block_size;
+
+	writer->fd = fd;
+	writer->block_size = (block_size + HONK_URING_ALIGNMENT - 1) / HONK_URING_ALIGNMENT * HONK_URING_ALIGNMENT;
+	writer->next_offset = (uint64_t)offset;
+
+	if (!ring_init(&writer->ring, HONK_URING_DEPTH))
+	{
+		free(writer);
+		return NULL;
+	}
+
+	if (!alloc_blocks(writer->blocks, writer->block_size))
+	{
+		ring_exit(&writer->ring);
+		free(writer);
+
+		return NULL;
+	}
+
+	int direct_fd = is_direct ? open_direct(fd, O_WRONLY, offset) : -1;
+	writer->is_direct = (direct_fd >= 0);
+	writer->ring_fd = writer->is_direct ? direct_fd : fd;
+
+	return writer;
+}
+
+uint8_t* honk_uring_writer_block(honk_uring_writer_t* writer)
+{
+	writer->blocks[0].state = HONK_BLOCK_STATE_READY;
+	return writer->blocks[0].data;
+}
+
+size_t honk_uring_writer_block_size(const honk_uring_writer_t* writer)
+{
+	return writer->block_size;
+}
+
+uint8_t* honk_uring_writer_submit(honk_uring_writer_t* writer, uint8_t* data, size_t* count)
+{
+	size_t size = writer->is_direct ? (*count - *count % HONK_URING_ALIGNMENT) : *count;
+
+	if (size == 0)
+	{
+		return data;
+	}
+
+	//Hand the filled block to the kernel:
+	honk_block_t* block = writer->blocks;
+
+	while (block->data != data)
+	{
+		block++;
+	}
+
+	block->state = HONK_BLOCK_STATE_BUSY;
+	block->offset = writer->next_offset;
+	block->size = size;
+
+	ring_submit(&writer->ring, IORING_OP_WRITE, writer->ring_fd, block->data, size, block->offset, (uint64_t)(block - writer->blocks));
+	writer->next_offset += size;
+
+	//Continue with a block that is not being written:
+	honk_block_t* next_block = NULL;
+
+	while (next_block == NULL)
+	{
+		for (size_t i = 0; (i < HONK_URING_DEPTH) && (next_block == NULL); i++)
+		{
+			if (writer->blocks[i].state == HONK_BLOCK_STATE_IDLE)
+			{
+				next_block = &writer->blocks[i];
+			}
+		}
+
+		if (next_block == NULL)
+		{
+			complete_write(writer);
+		}
+	}
+
+	next_block->state = HONK_BLOCK_STATE_READY;
+
+	//Take the unaligned rest along:
+	*count -= size;
+	memcpy(next_block->data, data + size, *count);
+
+	return next_block->data;
+}
+
+void honk_uring_writer_destroy(honk_uring_writer_t* writer, uint8_t* data, size_t count)
+{
+	for (size_t i = 0; i < HONK_URING_DEPTH; i++)
+	{
+		while (writer->blocks[i].state == HONK_BLOCK_STATE_BUSY)
+		{
+			complete_write(writer);
+		}
+	}
+
+	//The last piece is written synchronously through the descriptor of the caller (it may be unaligned):
+	if (writer->is_direct)
+	{
+		close(writer->ring_fd);
+	}
+
+	honk_io_pwrite_full(writer->fd, data, count, writer->next_offset);
+	lseek(writer->fd, (off_t)(writer->next_offset + count), SEEK_SET);
+
+	free_blocks(writer->blocks);
+	ring_exit(&writer->ring);
+	free(writer);
+}
+
+#else
+
+honk_uring_reader_t* honk_uring_reader_create(int fd, off_t offset, size_t block_size, bool is_direct)
+{
+	(void)fd; (void)offset; (void)block_size; (void)is_direct;
+	return NULL;
+}
+
+void honk_uring_reader_destroy(honk_uring_reader_t* reader)
+{
+	(void)reader;
+}
+
+size_t honk_uring_reader_read(honk_uring_reader_t* reader, uint8_t* dst, size_t size)
+{
+	(void)reader; (void)dst; (void)size;
+	return 0;
+}
+
+honk_uring_writer_t* honk_uring_writer_create(int fd, off_t offset, size_t block_size, bool is_direct)
+{
+	(void)fd; (void)offset; (void)block_size; (void)is_direct;
+	return NULL;
+}
+
+uint8_t* honk_uring_writer_block(honk_uring_writer_t* writer)
+{
+	(void)writer;
+	return NULL;
+}
+
+size_t honk_uring_writer_block_size(const honk_uring_writer_t* writer)
+{
+	(void)writer;
+	return 0;
+}
+
+uint8_t* honk_uring_writer_submit(honk_uring_writer_t* writer, uint8_t* data, size_t* count)
+{
+	(void)writer; (void)count;
+	return data;
+}
+
+void honk_uring_writer_destroy(honk_uring_writer_t* writer, uint8_t* data, size_t count)
+{
+	(void)writer; (void)data; (void)count;
+}
+
+#endif
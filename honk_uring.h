@@ -0,0 +1,51 @@
+#ifndef __HONK_URING_H__
+#define __HONK_URING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+//Number of blocks an io_uring reader / writer keeps in flight:
+#define HONK_URING_DEPTH 4
+
+//Alignment of the blocks, offsets and sizes for O_DIRECT:
+#define HONK_URING_ALIGNMENT ((size_t)4096)
+
+//Reads a regular file ahead through io_uring.
+//HONK_URING_DEPTH blocks are read at once, and a block is read again as soon as it has been consumed.
+typedef struct __honk_uring_reader_t__ honk_uring_reader_t;
+
+//Writes a regular file behind through io_uring.
+//The writer owns HONK_URING_DEPTH blocks: the one that is filled and the ones that are being written.
+typedef struct __honk_uring_writer_t__ honk_uring_writer_t;
+
+//Start reading a regular file from the given offset in blocks of block_size bytes (with O_DIRECT if possible and wanted).
+//Returns NULL if io_uring is unavailable or the file descriptor is no regular file, so the caller can fall back to read().
+honk_uring_reader_t* honk_uring_reader_create(int fd, off_t offset, size_t block_size, bool is_direct);
+
+//Wait for all reads and release the reader. The file offset is left behind the consumed bytes.
+void honk_uring_reader_destroy(honk_uring_reader_t* reader);
+
+//Copy up to size of the next bytes to dst, waiting for them if necessary. Returns 0 at the end of the file.
+size_t honk_uring_reader_read(honk_uring_reader_t* reader, uint8_t* dst, size_t size);
+
+//Start writing a regular file at the given offset in blocks of block_size bytes (with O_DIRECT if possible and wanted).
+//Returns NULL if io_uring is unavailable or the file descriptor is no regular file, so the caller can fall back to write().
+honk_uring_writer_t* honk_uring_writer_create(int fd, off_t offset, size_t block_size, bool is_direct);
+
+//Get the block to fill first. It has HONK_IO_SLACK accessible bytes behind its block size.
+uint8_t* honk_uring_writer_block(honk_uring_writer_t* writer);
+
+//Get the size of the blocks (the requested one, rounded up to the alignment):
+size_t honk_uring_writer_block_size(const honk_uring_writer_t* writer);
+
+//Submit count bytes of the given block and get the next one to fill.
+//With O_DIRECT, only whole aligned pieces are written. The rest is moved to the front of the next block and count is set to its size.
+uint8_t* honk_uring_writer_submit(honk_uring_writer_t* writer, uint8_t* block, size_t* count);
+
+//Write the last count bytes of the given block, wait for all writes and release the writer.
+//The file offset is left behind the written bytes.
+void honk_uring_writer_destroy(honk_uring_writer_t* writer, uint8_t* block, size_t count);
+
+#endif
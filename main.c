@@ -1,303 +1,954 @@
+//SEEK_DATA and SEEK_HOLE are extensions:
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define MAX_BLOCK_SIZE ((size_t)127)
-#define BUF_SIZE 4096
-
-typedef enum __honk_compress_state_t__
-{
-	HONK_COMPRESS_STATE_RLE,
-	HONK_COMPRESS_STATE_BLOCK
-} honk_compress_state_t;
-
-typedef enum __honk_decompress_state_t__
-{
-	HONK_DECOMPRESS_STATE_STATUS,
-	HONK_DECOMPRESS_STATE_RLE,
-	HONK_DECOMPRESS_STATE_BLOCK
-} honk_decompress_state_t;
+#include "honk.h"
+#include "honk_codec.h"
+#include "honk_container.h"
+#include "honk_io.h"
+#include "honk_parallel.h"
 
 //Get stdin, opened in binary mode:
-static FILE* get_stdin_binary(void);
+static int get_stdin_binary(void);
 
 //Get stdout, opened in binary mode:
-static FILE* get_stdout_binary(void);
+static int get_stdout_binary(void);
+
+//Parse a size argument with an optional K / M / G suffix:
+static bool parse_size(const char* arg, size_t* size);
+
+//Print the options and quit:
+static void print_usage(void);
+
+//Compress a regular file straight from a mapping of it. Returns false if it cannot be mapped.
+static bool honk_compress_mapped(int fd, off_t offset, honk_output_t* output, honk_layout_t layout);
+
+//Find the next data (or hole) of a file at or behind pos with SEEK_DATA (or SEEK_HOLE). Positions are relative to the offset and capped at end.
+static uint64_t find_extent(int fd, off_t offset, uint64_t pos, uint64_t end, bool is_data);
+
+//Report a damaged input and quit:
+static void exit_bad_format(void);
+
+//Write the decoded bytes [begin, end) of a complete token, flushing the output as necessary:
+static void write_token(const uint8_t* input, const honk_token_t* token, size_t begin, size_t end, honk_output_t* output);
+
+//Decode tokens until limit bytes of the input are consumed or the input ends. Returns the number of consumed bytes.
+//Tokens must not cross the limit. Wide tokens must fit into the input buffer.
+static uint64_t decode_token_stream(honk_input_t* input, honk_output_t* output, uint64_t limit, bool is_wide);
+
+//Decompress a v2 container chunk by chunk:
+static void honk_decompress_v2(honk_input_t* input, honk_output_t* output);
+
+//Pick the parallel decoder that fits the input and the output:
+static void honk_decompress_threaded(honk_input_t* input, honk_output_t* output, off_t input_offset, const char* index_path, size_t threads_count, size_t chunk_size);
 
-//Write a single byte to the output:
-static void write_byte(FILE* output, uint8_t new_byte);
+//Decompress a regular file into a regular file through mappings of both. The size of the output is known up front
+//from the chunk table of a v2 container or from a scan of a legacy stream. Returns false if the files cannot be mapped.
+static bool honk_decompress_into_mapping(int input_fd, off_t input_offset, int output_fd, const char* index_path, size_t threads_count, size_t chunk_size);
 
-//Write a status byte to the output:
-static void write_status_byte(FILE* output, bool is_rle, size_t bytes_count);
+//Scan a legacy stream and write its sidecar index:
+static void honk_build_index(honk_input_t* input, int output_fd, size_t interval);
 
-//Write a RLE run (status byte + content byte):
-static void write_rle_run(FILE* output, uint8_t byte, size_t count);
+//Write the part of the decoded tokens that lies in the range: skip_count bytes are dropped first, then up to remaining bytes are written.
+//Tokens in front of the range are hopped over without expanding them. Returns the number of consumed bytes (complete tokens only).
+static size_t extract_tokens(const uint8_t* input, size_t input_count, honk_output_t* output, uint64_t* skip_count, uint64_t* remaining, bool is_wide);
 
-//Write a block (status byte + block bytes):
-static void write_block(FILE* output, const uint8_t* block, size_t count);
+//Like decode_token_stream(), but only the range is written. Stops as soon as the range is complete.
+static uint64_t extract_token_stream(honk_input_t* input, honk_output_t* output, uint64_t limit, uint64_t* skip_count, uint64_t* remaining, bool is_wide);
 
-static FILE* get_stdin_binary(void)
+//Write the part of the bytes of a stored chunk that lies in the range (like extract_tokens(), without any decoding):
+static void extract_bytes(const uint8_t* input, size_t input_count, honk_output_t* output, uint64_t* skip_count, uint64_t* remaining);
+
+//Like extract_bytes(), for the next size bytes of the input. Stops as soon as the range is complete.
+//Returns false if the input ends before.
+static bool extract_stored(honk_input_t* input, honk_output_t* output, uint64_t size, uint64_t* skip_count, uint64_t* remaining);
+
+//Consume the given number of input bytes. Returns false if the input ends before.
+static bool skip_input(honk_input_t* input, uint64_t size);
+
+//Write a range of the decoded bytes through a reader, which starts right at the chunk that contains it:
+static void honk_extract_indexed(honk_reader_t* reader, honk_output_t* output, uint64_t offset, uint64_t length);
+
+//Write a range of the decoded bytes, reading the input sequentially (v2 chunks in front of the range are skipped as a whole):
+static void honk_extract_stream(honk_input_t* input, honk_output_t* output, uint64_t offset, uint64_t length);
+
+//Write a range of the decoded bytes, using the chunk table or sidecar index if there is one:
+static void honk_extract(honk_input_t* input, honk_output_t* output, off_t input_offset, const char* index_path, uint64_t offset, uint64_t length);
+
+//Load the sidecar index of a legacy stream from the given path and quit if it does not fit:
+static void load_sidecar(honk_index_t* index, const char* index_path, int fd, off_t input_offset);
+
+//Can the name be used in C identifiers?
+static bool is_identifier(const char* name);
+
+//Append formatted text to the output:
+static void write_text(honk_output_t* output, const char* format, ...);
+
+//Compress the input into a C/C++ header that defines it as an asset of the given name (which is decoded on first access):
+static void honk_emit_header(honk_input_t* input, honk_output_t* output, const char* name);
+
+static int get_stdin_binary(void)
 {
 	//For our dearest Windows users ... binary != text for you!
 #ifdef WIN32
 	_setmode(STDIN_FILENO, _O_BINARY);
 #endif
-	return stdin;
+	return STDIN_FILENO;
 }
 
-static FILE* get_stdout_binary(void)
+static int get_stdout_binary(void)
 {
 	//See get_stdin_binary() ...
 #ifdef WIN32
 	_setmode(STDOUT_FILENO, _O_BINARY);
 #endif
-	return stdout;
+	return STDOUT_FILENO;
 }
 
-static void write_byte(FILE* output, uint8_t new_byte)
+static bool parse_size(const char* arg, size_t* size)
 {
-	if (fputc((int)new_byte, output) == EOF)
+	char* end;
+	unsigned long long value = strtoull(arg, &end, 10);
+
+	if ((end == arg) || (arg[0] == '-'))
 	{
-		fprintf(stderr, "Error while writing to output file descriptor.\n");
-		exit(EXIT_FAILURE);
+		return false;
 	}
+
+	switch (*end)
+	{
+	case 'G': case 'g': value <<= 10; //Fall through
+	case 'M': case 'm': value <<= 10; //Fall through
+	case 'K': case 'k': value <<= 10; end++; break;
+	case '\0': break;
+	default: return false;
+	}
+
+	if (*end != '\0')
+	{
+		return false;
+	}
+
+	*size = (size_t)value;
+	return true;
+}
+
+static void print_usage(void)
+{
+	fprintf(stderr,
+		"Usage: honkpack [-d] [options] < input > output\n"
+		"\n"
+		"  -d                     Decompress (legacy streams and v2 containers are told apart automatically)\n"
+		"  -b <size>              Size of the I/O buffers (at least 4K)\n"
+		"  -T <threads count>     Compress / decompress in chunks on this many threads\n"
+		"  -c <size>              Size of the chunks (4K ... 1G)\n"
+		"  --v2                   Write a v2 container with a chunk table (older honkpack binaries reject it)\n"
+		"  --wide                 Write a v2 container with 15 bit token counts\n"
+		"  --long                 Write escape tokens for long runs and blocks. Such legacy streams are shorter,\n"
+		"                         but a honkpack -d without escape support decodes them into wrong bytes!\n"
+		"  --compat               Write no escape tokens (the default)\n"
+		"  --build-index          Write a sidecar index for a legacy stream\n"
+		"  --index <path>         Decompress along a sidecar index\n"
+		"  --offset <offset>      Decompress from this offset of the decoded bytes on (with -d)\n"
+		"  --length <length>      Decompress this many decoded bytes (with -d)\n"
+		"  --uring / --direct     Read ahead and write behind through io_uring (with O_DIRECT)\n"
+		"  --pipeline             Read ahead and write behind on threads of their own\n"
+		"  --vmsplice             Pass the output pages to a pipe on stdout\n"
+		"  --emit-header <name>   Write a C/C++ header with the compressed input\n");
+
+	exit(EXIT_FAILURE);
 }
 
-static void write_status_byte(FILE* output, bool is_rle, size_t bytes_count)
+static void honk_compress(honk_input_t* input, honk_output_t* output, honk_layout_t layout)
 {
-	uint8_t status_byte = (uint8_t)bytes_count;
+	honk_encoder_t encoder;
+	honk_encoder_init(&encoder, layout);
 
-	if (is_rle)
+	//Read the input file block-wise and feed it to the encoder.
+	//The input keeps the last byte of the previous read in front of the buffer, so the encoder can always look one byte back.
+	while (honk_input_refill(input) > 0)
 	{
-		status_byte |= (1 << 7);
+		honk_encoder_update(&encoder, input->data, input->count, output);
+		input->pos = input->count;
 	}
 
-	write_byte(output, status_byte);
+	//Write the last block if necessary:
+	honk_encoder_finish(&encoder, output);
 }
 
-static void write_rle_run(FILE* output, uint8_t byte, size_t count)
+static uint64_t find_extent(int fd, off_t offset, uint64_t pos, uint64_t end, bool is_data)
 {
-	//Write the status byte:
-	write_status_byte(output, true, count);
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	off_t found = (pos < end) ? lseek(fd, offset + (off_t)pos, is_data ? SEEK_DATA : SEEK_HOLE) : -1;
 
-	//Write the RLE content once:
-	write_byte(output, byte);
+	if (found >= 0)
+	{
+		return ((uint64_t)(found - offset) < end) ? (uint64_t)(found - offset) : end;
+	}
+
+	//There is no data behind the last hole:
+	if ((pos < end) && is_data && (errno == ENXIO))
+	{
+		return end;
+	}
+#else
+	(void)fd;
+	(void)offset;
+#endif
+
+	//Without support for holes, everything is data:
+	return is_data ? pos : end;
 }
 
-static void write_block(FILE* output, const uint8_t* block, size_t count)
+static bool honk_compress_mapped(int fd, off_t offset, honk_output_t* output, honk_layout_t layout)
 {
-	//Write the status byte:
-	write_status_byte(output, false, count);
+	honk_mapping_t mapping;
 
-	//Flush the block via fwrite():
-	if (fwrite(block, 1, count, output) != count)
+	if (!honk_io_map_input(&mapping, fd, offset))
 	{
-		fprintf(stderr, "Error while writing to output file descriptor.\n");
-		exit(EXIT_FAILURE);
+		return false;
 	}
+
+	//The encoder scans the mapping and writes its blocks straight from it:
+	honk_encoder_t encoder;
+	honk_encoder_init_mapped(&encoder, layout);
+
+	//Holes of sparse files are not read, the encoder just writes their runs of zeros:
+	uint64_t pos = 0;
+
+	while (pos < mapping.count)
+	{
+		uint64_t data_pos = find_extent(fd, offset, pos, mapping.count, true);
+		uint64_t hole_pos = find_extent(fd, offset, data_pos, mapping.count, false);
+
+		honk_encoder_update_zeros(&encoder, mapping.data + pos, (size_t)(data_pos - pos), output);
+		honk_encoder_update(&encoder, mapping.data + data_pos, (size_t)(hole_pos - data_pos), output);
+
+		pos = hole_pos;
+	}
+
+	honk_encoder_finish(&encoder, output);
+
+	honk_io_unmap(&mapping);
+
+	//Leave the file offset behind the input, as if we had read it:
+	lseek(fd, 0, SEEK_END);
+
+	return true;
+}
+
+static void exit_bad_format(void)
+{
+	fprintf(stderr, "Error while decompressing: Bad format\n");
+	exit(EXIT_FAILURE);
+}
+
+static void write_token(const uint8_t* input, const honk_token_t* token, size_t begin, size_t end, honk_output_t* output)
+{
+	const uint8_t* content = input + token->content_offset;
+
+	if (token->is_rle)
+	{
+		honk_output_fill(output, content[0], end - begin);
+	}
+	else
+	{
+		honk_output_write(output, content + begin, end - begin);
+	}
+}
+
+static uint64_t decode_token_stream(honk_input_t* input, honk_output_t* output, uint64_t limit, bool is_wide)
+{
+	uint64_t consumed = 0;
+
+	for (;;)
+	{
+		//Decode the complete tokens within the limit:
+		size_t available = input->count - input->pos;
+		bool is_limited = (limit - consumed < available);
+
+		if (is_limited)
+		{
+			available = (size_t)(limit - consumed);
+		}
+
+		size_t tokens_size = honk_decode_tokens(input->data + input->pos, available, output->data, output->capacity, &output->count, is_wide);
+
+		input->pos += tokens_size;
+		consumed += tokens_size;
+
+		if (consumed == limit)
+		{
+			break;
+		}
+
+		//If the next token is complete, the output is too full for it.
+		//It is written on its own then (an escaped run may not even fit into the empty buffer):
+		size_t remaining = available - tokens_size;
+		honk_token_t token;
+
+		if ((remaining > 0) && honk_read_token(input->data + input->pos, remaining, is_wide, &token) && (remaining >= token.size))
+		{
+			write_token(input->data + input->pos, &token, 0, token.count, output);
+
+			input->pos += token.size;
+			consumed += token.size;
+
+			continue;
+		}
+
+		//Otherwise, the token is cut off by the limit or we need more input.
+		//Incomplete tokens are kept by the input, so the buffer never starts mid-token.
+		if (is_limited || (honk_input_refill(input) == 0))
+		{
+			break;
+		}
+	}
+
+	return consumed;
 }
 
-static void honk_compress(FILE* input, FILE* output)
+static void honk_decompress_v2(honk_input_t* input, honk_output_t* output)
 {
-	//Start in the (empty) block state:
-	honk_compress_state_t state = HONK_COMPRESS_STATE_BLOCK;
+	honk_v2_header_t header;
 
-	size_t count = 0;
-	uint8_t last_byte = 0;
-	uint8_t block[MAX_BLOCK_SIZE];
+	if (!honk_input_ensure(input, HONK_V2_HEADER_SIZE) || !honk_v2_read_header(input->data + input->pos, &header))
+	{
+		exit_bad_format();
+	}
 
-	//Read the input file block-wise and process each byte:
-	uint8_t buf[BUF_SIZE];
-	size_t bytes_count;
+	input->pos += HONK_V2_HEADER_SIZE;
 
-	while ((bytes_count = fread(buf, 1, BUF_SIZE, input)) > 0)
+	//Wide tokens may be larger than the input buffer:
+	bool is_wide = honk_v2_has_wide_tokens(&header);
+
+	if (is_wide)
+	{
+		honk_input_grow(input, HONK_MAX_WIDE_TOKEN_SIZE);
+	}
+
+	//Decode the chunks up to the end of chunks.
+	//The chunk table and the footer are only needed for random access, so we do not read them.
+	for (;;)
 	{
-		//Process the new bytes:
-		for (size_t i = 0; i < bytes_count; i++)
+		honk_v2_chunk_header_t chunk_header;
+
+		if (!honk_input_ensure(input, HONK_V2_CHUNK_HEADER_SIZE) || !honk_v2_read_chunk_header(input->data + input->pos, &chunk_header))
+		{
+			exit_bad_format();
+		}
+
+		input->pos += HONK_V2_CHUNK_HEADER_SIZE;
+
+		if (chunk_header.payload_size == 0)
+		{
+			break;
+		}
+
+		//Stored chunks are copied as they are:
+		if (chunk_header.is_stored)
 		{
-			uint8_t new_byte = buf[i];
+			uint64_t skip_count = 0;
+			uint64_t remaining = UINT64_MAX;
 
-			switch (state)
+			if (!extract_stored(input, output, chunk_header.payload_size, &skip_count, &remaining))
 			{
-			case HONK_COMPRESS_STATE_RLE:
-
-				//If we see another byte, the RLE must be closed and we move to the block state:
-				if (new_byte != last_byte)
-				{
-					//Write run:
-					write_rle_run(output, last_byte, count);
-
-					//Change state:
-					last_byte = new_byte;
-					block[0] = new_byte;
-					count = 1;
-					state = HONK_COMPRESS_STATE_BLOCK;
-				}
-				else
-				{
-					//Increment the number of bytes.
-					//Is the RLE full?
-					if (++count == MAX_BLOCK_SIZE)
-					{
-						//Write run:
-						write_rle_run(output, last_byte, MAX_BLOCK_SIZE);
-
-						//Move to the (empty) block state:
-						count = 0;
-						state = HONK_COMPRESS_STATE_BLOCK;
-					}
-				}
-
-				break;
-
-			case HONK_COMPRESS_STATE_BLOCK:
-
-				//If we see the same byte twice, the block must be closed and we move to RLE:
-				if ((count > 0) && (new_byte == last_byte))
-				{
-					//The last byte is *not* part of the block:
-					size_t actual_bytes_count = count - 1;
-
-					//Write block:
-					if (actual_bytes_count > 0)
-					{
-						write_block(output, block, actual_bytes_count);
-					}
-
-					//Change state:
-					count = 2;
-					state = HONK_COMPRESS_STATE_RLE;
-				}
-				else
-				{
-					//Add the new byte to the block and increment the number of bytes:
-					block[count] = new_byte;
-
-					//Is the block full?
-					if (++count == MAX_BLOCK_SIZE)
-					{
-						//Write block:
-						write_block(output, block, MAX_BLOCK_SIZE);
-
-						//Stay in the (empty) block state:
-						count = 0;
-					}
-					else
-					{
-						//Remember the new byte:
-						last_byte = new_byte;
-					}
-				}
-
-				break;
+				exit_bad_format();
 			}
+
+			continue;
+		}
+
+		uint64_t output_begin = output->offset + output->count;
+
+		if ((decode_token_stream(input, output, chunk_header.payload_size, is_wide) != chunk_header.payload_size) || (output->offset + output->count - output_begin != chunk_header.uncompressed_size))
+		{
+			exit_bad_format();
 		}
 	}
+}
 
-	//Write the last block if necessary:
-	switch (state)
+static void honk_decompress(honk_input_t* input, honk_output_t* output)
+{
+	//V2 container or legacy stream?
+	if (honk_input_ensure(input, HONK_V2_MAGIC_SIZE) && honk_v2_has_magic(input->data + input->pos, HONK_V2_MAGIC_SIZE))
 	{
-	case HONK_COMPRESS_STATE_RLE:
+		honk_decompress_v2(input, output);
+		return;
+	}
+
+	decode_token_stream(input, output, UINT64_MAX, false);
+
+	//Validate the state (a token must not be cut off):
+	if (!honk_is_stream_tail(input->data + input->pos, input->count - input->pos, false))
+	{
+		exit_bad_format();
+	}
+}
 
-		//Write run:
-		write_rle_run(output, last_byte, count);
-		break;
+static size_t extract_tokens(const uint8_t* input, size_t input_count, honk_output_t* output, uint64_t* skip_count, uint64_t* remaining, bool is_wide)
+{
+	//Hop over the tokens in front of the range:
+	size_t i = honk_skip_tokens(input, input_count, skip_count, is_wide);
 
-	case HONK_COMPRESS_STATE_BLOCK:
+	while ((i < input_count) && (*remaining > 0))
+	{
+		honk_token_t token;
 
-		//Write block:
-		if (count > 0)
+		if (!honk_read_token(input + i, input_count - i, is_wide, &token) || (input_count - i < token.size))
 		{
-			write_block(output, block, count);
+			break;
+		}
+
+		//A token that crosses a border of the range (or does not fit into the output) is written on its own and cut:
+		if ((*skip_count > 0) || (token.count > *remaining) || (token.count > output->capacity - output->count))
+		{
+			size_t begin = (size_t)*skip_count;
+			size_t end = (token.count - begin > *remaining) ? (begin + (size_t)*remaining) : token.count;
+
+			write_token(input + i, &token, begin, end, output);
+
+			*skip_count = 0;
+			*remaining -= end - begin;
+			i += token.size;
+
+			continue;
 		}
 
-		break;
+		//The tokens within the range are decoded in bulk, as far as the output and the range allow:
+		size_t output_begin = output->count;
+		size_t capacity = (output->capacity - output->count > *remaining) ? (output->count + (size_t)*remaining) : output->capacity;
+		size_t tokens_size = honk_decode_tokens(input + i, input_count - i, output->data, capacity, &output->count, is_wide);
+
+		i += tokens_size;
+		*remaining -= output->count - output_begin;
 	}
+
+	return i;
 }
 
-static void honk_decompress(FILE* input, FILE* output)
+static uint64_t extract_token_stream(honk_input_t* input, honk_output_t* output, uint64_t limit, uint64_t* skip_count, uint64_t* remaining, bool is_wide)
 {
-	//Start in the status state:
-	honk_decompress_state_t state = HONK_DECOMPRESS_STATE_STATUS;
-	size_t count = 0;
+	uint64_t consumed = 0;
 
-	//Read the input file block-wise and process each byte:
-	uint8_t buf[BUF_SIZE];
-	size_t bytes_count;
+	for (;;)
+	{
+		size_t available = input->count - input->pos;
+		bool is_limited = (limit - consumed < available);
 
-	while ((bytes_count = fread(buf, 1, BUF_SIZE, input)) > 0)
+		if (is_limited)
+		{
+			available = (size_t)(limit - consumed);
+		}
+
+		size_t tokens_size = extract_tokens(input->data + input->pos, available, output, skip_count, remaining, is_wide);
+
+		input->pos += tokens_size;
+		consumed += tokens_size;
+
+		//Everything that is left is an incomplete token:
+		if ((consumed == limit) || (*remaining == 0) || is_limited || (honk_input_refill(input) == 0))
+		{
+			break;
+		}
+	}
+
+	return consumed;
+}
+
+static void extract_bytes(const uint8_t* input, size_t input_count, honk_output_t* output, uint64_t* skip_count, uint64_t* remaining)
+{
+	size_t begin = (*skip_count < input_count) ? (size_t)*skip_count : input_count;
+	size_t end = (input_count - begin > *remaining) ? (begin + (size_t)*remaining) : input_count;
+
+	honk_output_write(output, input + begin, end - begin);
+
+	*skip_count -= begin;
+	*remaining -= end - begin;
+}
+
+static bool extract_stored(honk_input_t* input, honk_output_t* output, uint64_t size, uint64_t* skip_count, uint64_t* remaining)
+{
+	while ((size > 0) && (*remaining > 0))
 	{
-		//Process the new bytes:
-		for (size_t i = 0; i < bytes_count; i++)
+		if ((input->pos == input->count) && (honk_input_refill(input) == 0))
 		{
-			uint8_t new_byte = buf[i];
+			return false;
+		}
 
-			switch (state)
-			{
-			case HONK_DECOMPRESS_STATE_STATUS:
+		size_t count = input->count - input->pos;
+		count = (size < count) ? (size_t)size : count;
 
-				//Read the block count:
-				count = (size_t)(new_byte & 0x7F);
+		extract_bytes(input->data + input->pos, count, output, skip_count, remaining);
 
-				//RLE or block?
-				if (new_byte & (1 << 7))
-				{
-					//If the length of the RLE would be 0, we read one byte that will be repeated 0 times (quite pointless).
-					state = HONK_DECOMPRESS_STATE_RLE;
-				}
-				else
-				{
-					//If the length of the block would be 0, we stay in HONK_DECOMPRESS_STATE_STATUS.
-					if (count > 0)
-					{
-						state = HONK_DECOMPRESS_STATE_BLOCK;
-					}
-				}
+		input->pos += count;
+		size -= count;
+	}
 
-				break;
+	return true;
+}
 
-			case HONK_DECOMPRESS_STATE_RLE:
+static bool skip_input(honk_input_t* input, uint64_t size)
+{
+	for (;;)
+	{
+		size_t count = input->count - input->pos;
+		count = (size < count) ? (size_t)size : count;
 
-				//Write n instances of our byte and move back to status state:
-				for (size_t i = 0; i < count; i++)
-				{
-					write_byte(output, new_byte);
-				}
+		input->pos += count;
+		size -= count;
 
-				state = HONK_DECOMPRESS_STATE_STATUS;
+		if (size == 0)
+		{
+			return true;
+		}
 
-				break;
+		if (honk_input_refill(input) == 0)
+		{
+			return false;
+		}
+	}
+}
+
+static void honk_extract_indexed(honk_reader_t* reader, honk_output_t* output, uint64_t offset, uint64_t length)
+{
+	//The reader decodes the chunks that the range touches (and the next one ahead, while we write), straight into the output buffer:
+	while (length > 0)
+	{
+		size_t count = (length < output->capacity) ? (size_t)length : output->capacity;
+		ssize_t bytes_count = honk_reader_pread(reader, honk_output_reserve(output, count), count, offset);
+
+		if ((bytes_count < 0) && (errno == EBADMSG))
+		{
+			exit_bad_format();
+		}
+
+		if (bytes_count < 0)
+		{
+			fprintf(stderr, "Error while reading from input file descriptor.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		//The range ends behind the file:
+		if (bytes_count == 0)
+		{
+			break;
+		}
+
+		honk_output_commit(output, (size_t)bytes_count);
+		offset += (uint64_t)bytes_count;
+		length -= (uint64_t)bytes_count;
+	}
+}
+
+static void honk_extract_stream(honk_input_t* input, honk_output_t* output, uint64_t offset, uint64_t length)
+{
+	uint64_t skip_count = offset;
+	uint64_t remaining = length;
+
+	//Legacy streams are hopped through token by token:
+	if (!honk_input_ensure(input, HONK_V2_MAGIC_SIZE) || !honk_v2_has_magic(input->data + input->pos, HONK_V2_MAGIC_SIZE))
+	{
+		extract_token_stream(input, output, UINT64_MAX, &skip_count, &remaining, false);
+
+		if ((remaining > 0) && !honk_is_stream_tail(input->data + input->pos, input->count - input->pos, false))
+		{
+			exit_bad_format();
+		}
+
+		return;
+	}
+
+	//V2 chunks in front of the range are skipped by their chunk headers:
+	honk_v2_header_t header;
 
-			case HONK_DECOMPRESS_STATE_BLOCK:
+	if (!honk_input_ensure(input, HONK_V2_HEADER_SIZE) || !honk_v2_read_header(input->data + input->pos, &header))
+	{
+		exit_bad_format();
+	}
+
+	input->pos += HONK_V2_HEADER_SIZE;
+
+	//Wide tokens may be larger than the input buffer:
+	bool is_wide = honk_v2_has_wide_tokens(&header);
+
+	if (is_wide)
+	{
+		honk_input_grow(input, HONK_MAX_WIDE_TOKEN_SIZE);
+	}
 
-				//Write the new byte and reduce the count.
-				//If all bytes of the block are read / written, we move back to status state.
-				write_byte(output, new_byte);
+	while (remaining > 0)
+	{
+		honk_v2_chunk_header_t chunk_header;
+
+		if (!honk_input_ensure(input, HONK_V2_CHUNK_HEADER_SIZE) || !honk_v2_read_chunk_header(input->data + input->pos, &chunk_header))
+		{
+			exit_bad_format();
+		}
 
-				if (--count == 0)
-				{
-					state = HONK_DECOMPRESS_STATE_STATUS;
-				}
+		input->pos += HONK_V2_CHUNK_HEADER_SIZE;
 
-				break;
+		if (chunk_header.payload_size == 0)
+		{
+			break;
+		}
+
+		if (skip_count >= chunk_header.uncompressed_size)
+		{
+			skip_count -= chunk_header.uncompressed_size;
+
+			if (!skip_input(input, chunk_header.payload_size))
+			{
+				exit_bad_format();
 			}
+
+			continue;
+		}
+
+		if (chunk_header.is_stored)
+		{
+			if (!extract_stored(input, output, chunk_header.payload_size, &skip_count, &remaining))
+			{
+				exit_bad_format();
+			}
+
+			continue;
+		}
+
+		if ((extract_token_stream(input, output, chunk_header.payload_size, &skip_count, &remaining, is_wide) != chunk_header.payload_size) && (remaining > 0))
+		{
+			exit_bad_format();
+		}
+	}
+}
+
+static void honk_extract(honk_input_t* input, honk_output_t* output, off_t input_offset, const char* index_path, uint64_t offset, uint64_t length)
+{
+	honk_reader_t* reader = NULL;
+	bool is_v2 = honk_input_ensure(input, HONK_V2_MAGIC_SIZE) && honk_v2_has_magic(input->data + input->pos, HONK_V2_MAGIC_SIZE);
+
+	//Legacy streams need a sidecar, v2 containers bring their chunk table if the input is seekable:
+	if (!is_v2 && (index_path != NULL))
+	{
+		int sidecar_fd = open(index_path, O_RDONLY);
+
+		if (sidecar_fd < 0)
+		{
+			fprintf(stderr, "Error while opening index file.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		reader = (input_offset >= 0) ? honk_reader_open_sidecar(input->fd, sidecar_fd, (uint64_t)input_offset, HONK_READER_DEFAULT_CACHE_SIZE) : NULL;
+		close(sidecar_fd);
+
+		if (reader == NULL)
+		{
+			fprintf(stderr, "Error while loading index file: It does not belong to a seekable input.\n");
+			exit(EXIT_FAILURE);
 		}
 	}
+	else if (is_v2 && (input_offset >= 0))
+	{
+		reader = honk_reader_open_fd(input->fd, (uint64_t)input_offset, HONK_READER_DEFAULT_CACHE_SIZE);
+	}
+
+	if (reader == NULL)
+	{
+		honk_extract_stream(input, output, offset, length);
+		return;
+	}
+
+	honk_extract_indexed(reader, output, offset, length);
+	honk_reader_close(reader);
+}
 
-	//Validate the state:
-	if (state != HONK_DECOMPRESS_STATE_STATUS)
+static void load_sidecar(honk_index_t* index, const char* index_path, int fd, off_t input_offset)
+{
+	int sidecar_fd = open(index_path, O_RDONLY);
+
+	if (sidecar_fd < 0)
 	{
-		fprintf(stderr, "Error while decompressing: Bad format\n");
+		fprintf(stderr, "Error while opening index file.\n");
 		exit(EXIT_FAILURE);
 	}
+
+	if ((input_offset < 0) || !honk_index_load_sidecar(index, sidecar_fd, fd, (uint64_t)input_offset))
+	{
+		fprintf(stderr, "Error while loading index file: It does not belong to a seekable input.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	close(sidecar_fd);
+}
+
+static void honk_decompress_threaded(honk_input_t* input, honk_output_t* output, off_t input_offset, const char* index_path, size_t threads_count, size_t chunk_size)
+{
+	honk_index_t index;
+
+	//Legacy streams are decoded along their sidecar if there is one, otherwise they are scanned for their token boundaries:
+	if (!honk_input_ensure(input, HONK_V2_MAGIC_SIZE) || !honk_v2_has_magic(input->data + input->pos, HONK_V2_MAGIC_SIZE))
+	{
+		if ((index_path != NULL) && honk_io_is_writable_file(output->fd))
+		{
+			load_sidecar(&index, index_path, input->fd, input_offset);
+			honk_decompress_indexed(&index, input->fd, (uint64_t)input_offset, output->fd, threads_count);
+			honk_index_destroy(&index);
+
+			return;
+		}
+
+		honk_decompress_parallel(input, output->fd, threads_count, chunk_size);
+		return;
+	}
+
+	//V2 containers in seekable files are decoded chunk-wise straight into their place:
+	if ((input_offset >= 0) && honk_io_is_writable_file(output->fd) && honk_index_load(&index, input->fd, (uint64_t)input_offset))
+	{
+		honk_decompress_indexed(&index, input->fd, (uint64_t)input_offset, output->fd, threads_count);
+		honk_index_destroy(&index);
+		return;
+	}
+
+	//Otherwise, we stream the chunks:
+	honk_decompress(input, output);
+}
+
+static bool honk_decompress_into_mapping(int input_fd, off_t input_offset, int output_fd, const char* index_path, size_t threads_count, size_t chunk_size)
+{
+	honk_mapping_t input;
+	off_t output_offset = honk_io_tell(output_fd);
+
+	if ((output_offset < 0) || !honk_io_is_writable_file(output_fd) || !honk_io_map_input(&input, input_fd, input_offset))
+	{
+		return false;
+	}
+
+	//V2 containers bring their chunk table, legacy streams are scanned from status byte to status byte (unless there is a sidecar):
+	honk_index_t index;
+
+	if (honk_v2_has_magic(input.data, input.count))
+	{
+		if (!honk_index_load(&index, input_fd, (uint64_t)input_offset))
+		{
+			honk_io_unmap(&input);
+			return false;
+		}
+	}
+	else if (index_path != NULL)
+	{
+		load_sidecar(&index, index_path, input_fd, input_offset);
+	}
+	else
+	{
+		honk_index_builder_t builder;
+		honk_index_builder_init(&builder, &index, chunk_size);
+		honk_index_builder_update(&builder, input.data, input.count);
+
+		if (!honk_index_builder_finish(&builder))
+		{
+			exit_bad_format();
+		}
+	}
+
+	//Give the output its final size and decode every chunk straight into its place:
+	honk_mapping_t output;
+	bool is_mapped = honk_io_map_output(&output, output_fd, output_offset, index.header.total_size);
+
+	if (is_mapped)
+	{
+		honk_decompress_mapped(&index, &input, &output, threads_count);
+		honk_io_unmap(&output);
+	}
+	else if (index.header.total_size > 0)
+	{
+		honk_decompress_indexed(&index, input_fd, (uint64_t)input_offset, output_fd, threads_count);
+	}
+
+	honk_index_destroy(&index);
+	honk_io_unmap(&input);
+
+	//Leave the file offsets behind the input and the output, as if we had streamed them:
+	lseek(input_fd, 0, SEEK_END);
+	lseek(output_fd, 0, SEEK_END);
+
+	return true;
+}
+
+static void honk_build_index(honk_input_t* input, int output_fd, size_t interval)
+{
+	//V2 containers carry their chunk table already:
+	if (honk_input_ensure(input, HONK_V2_MAGIC_SIZE) && honk_v2_has_magic(input->data + input->pos, HONK_V2_MAGIC_SIZE))
+	{
+		fprintf(stderr, "Error while building index: The input is a v2 container with a chunk table.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	honk_index_t index;
+
+	if (!honk_index_build_sidecar(&index, input, interval))
+	{
+		exit_bad_format();
+	}
+
+	honk_index_write_sidecar(&index, output_fd);
+	honk_index_destroy(&index);
+}
+
+static bool is_identifier(const char* name)
+{
+	if (!isalpha((unsigned char)name[0]) && (name[0] != '_'))
+	{
+		return false;
+	}
+
+	for (size_t i = 1; name[i] != '\0'; i++)
+	{
+		if (!isalnum((unsigned char)name[i]) && (name[i] != '_'))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void write_text(honk_output_t* output, const char* format, ...)
+{
+	char text[1024];
+	va_list args;
+	va_list retry_args;
+
+	va_start(args, format);
+	va_copy(retry_args, args);
+	int count = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (count < 0)
+	{
+		fprintf(stderr, "Error while formatting header text.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Long lines (e.g. of long names) are formatted again into a buffer of their size:
+	if ((size_t)count >= sizeof(text))
+	{
+		char* long_text = malloc((size_t)count + 1);
+
+		if (long_text == NULL)
+		{
+			fprintf(stderr, "Error while allocating header text.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		vsnprintf(long_text, (size_t)count + 1, format, retry_args);
+		honk_output_write(output, (const uint8_t*)long_text, (size_t)count);
+
+		free(long_text);
+	}
+	else
+	{
+		honk_output_write(output, (const uint8_t*)text, (size_t)count);
+	}
+
+	va_end(retry_args);
+}
+
+static void honk_emit_header(honk_input_t* input, honk_output_t* output, const char* name)
+{
+	//The tokens go into memory first, as the header starts with their size.
+	//The compat layout can be decoded by the header-only honk::codec<uint8_t> as well.
+	honk_output_t packed;
+	honk_output_init_memory(&packed, HONK_IO_DEFAULT_BUFFER_SIZE);
+
+	honk_encoder_t encoder;
+	honk_encoder_init(&encoder, HONK_LAYOUT_COMPAT);
+	uint64_t size = 0;
+
+	while (honk_input_refill(input) > 0)
+	{
+		honk_encoder_update(&encoder, input->data, input->count, &packed);
+		size += input->count;
+		input->pos = input->count;
+	}
+
+	honk_encoder_finish(&encoder, &packed);
+
+	//The macros are named in capitals:
+	char macro[256];
+	size_t length = strlen(name);
+
+	for (size_t i = 0; i <= length; i++)
+	{
+		macro[i] = (char)toupper((unsigned char)name[i]);
+	}
+
+	write_text(output, "//Generated by honkpack --emit-header. Do not edit.\n");
+	write_text(output, "//C++ needs C++17 (for inline variables). In C, define HONK_%s_IMPLEMENTATION in front of the include in exactly one source file.\n", macro);
+	write_text(output, "#ifndef __HONK_ASSET_%s_H__\n#define __HONK_ASSET_%s_H__\n\n", macro, macro);
+	write_text(output, "#define %s_SIZE %lluu\n#define %s_PACKED_SIZE %lluu\n\n", macro, (unsigned long long)size, macro, (unsigned long long)packed.count);
+
+	//A single copy of the tokens: an inline variable in C++, the definition in the implementation file in C (the other files only see declarations).
+	write_text(output, "#ifdef __cplusplus\n\n#define %s_STORAGE inline\n\n#else\n\n#define %s_STORAGE\n\n", macro, macro);
+	write_text(output, "extern const unsigned char %s_packed[%s_PACKED_SIZE + 1];\n\n", name, macro);
+	write_text(output, "//Get the decoded bytes, which are decoded on first access (NULL if the asset is broken):\n");
+	write_text(output, "const unsigned char* %s_data(void);\n\n#endif\n\n", name);
+	write_text(output, "#if defined(__cplusplus) || defined(HONK_%s_IMPLEMENTATION)\n\n", macro);
+	write_text(output, "%s_STORAGE const unsigned char %s_packed[%s_PACKED_SIZE + 1] =\n{", macro, name, macro);
+
+	for (size_t i = 0; i < packed.count; i++)
+	{
+		write_text(output, "%s0x%02X,", ((i % 16) == 0) ? "\n\t" : " ", packed.data[i]);
+	}
+
+	write_text(output, "%s0\n};\n\n#endif\n\n", (packed.count > 0) ? " " : "\n\t");
+
+	//C++ gets a honk::lazy_asset, C a function that decodes with libhonk (the buffer is zero-initialized, so it takes no space in the binary):
+	write_text(output, "#ifdef __cplusplus\n\n#include \"honk.hpp\"\n\n");
+	write_text(output, "inline unsigned char %s_bytes[%s_SIZE + 1];\n", name, macro);
+	write_text(output, "inline honk::lazy_asset<%s_SIZE> %s(%s_packed, %s_PACKED_SIZE, %s_bytes);\n\n", macro, name, name, macro, name);
+	write_text(output, "#elif defined(HONK_%s_IMPLEMENTATION)\n\n#include <pthread.h>\n\n#include \"honk.h\"\n\n", macro);
+	write_text(output, "static unsigned char %s_bytes[%s_SIZE + 1];\n", name, macro);
+	write_text(output, "static const unsigned char* %s_result;\n", name);
+	write_text(output, "static pthread_once_t %s_once = PTHREAD_ONCE_INIT;\n\n", name);
+	write_text(output, "static void %s_decode(void)\n{\n", name);
+	write_text(output, "\tif (honk_decompress_buffer(%s_packed, %s_PACKED_SIZE, %s_bytes, %s_SIZE) == (int64_t)%s_SIZE)\n", name, macro, name, macro, macro);
+	write_text(output, "\t{\n\t\t%s_result = %s_bytes;\n\t}\n}\n\n", name, name);
+	write_text(output, "const unsigned char* %s_data(void)\n{\n", name);
+	write_text(output, "\tpthread_once(&%s_once, %s_decode);\n\treturn %s_result;\n}\n\n", name, name, name);
+	write_text(output, "#endif\n\n#endif\n");
+
+	honk_output_destroy(&packed);
 }
 
 int main(int argc, char** argv)
 {
 	//Compression / Decompression?
 	bool is_compress_mode = true;
+	size_t buffer_size = HONK_IO_DEFAULT_BUFFER_SIZE;
+	size_t threads_count = 1;
+	size_t chunk_size = HONK_PARALLEL_DEFAULT_CHUNK_SIZE;
+	honk_format_t format = HONK_FORMAT_LEGACY;
+	honk_layout_t layout = HONK_LAYOUT_COMPAT;
+	bool is_index_mode = false;
+	const char* index_path = NULL;
+	bool is_range_mode = false;
+	size_t range_offset = 0;
+	size_t range_length = SIZE_MAX;
+	bool is_async_mode = false;
+	bool is_direct_mode = false;
+	bool is_pipeline_mode = false;
+	bool is_splice_mode = false;
+	const char* header_name = NULL;
 
 	//Check parameters:
 	for (int i = 1; i < argc; i++)
@@ -307,34 +958,225 @@ int main(int argc, char** argv)
 		if (strcmp(arg, "-d") == 0)
 		{
 			is_compress_mode = false;
-			break;
 		}
+		else if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0))
+		{
+			print_usage();
+		}
+		else if (strcmp(arg, "-b") == 0)
+		{
+			//Size of the I/O buffers:
+			if ((++i == argc) || !parse_size(argv[i], &buffer_size) || (buffer_size < HONK_IO_MIN_BUFFER_SIZE))
+			{
+				fprintf(stderr, "Usage: -b <buffer size> (at least 4K, e.g. 16M)\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "-T") == 0)
+		{
+			//Number of worker threads:
+			if ((++i == argc) || !parse_size(argv[i], &threads_count) || (threads_count == 0) || (threads_count > 1024))
+			{
+				fprintf(stderr, "Usage: -T <threads count> (1 ... 1024)\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "-c") == 0)
+		{
+			//Size of the chunks for parallel compression / decompression:
+			if ((++i == argc) || !parse_size(argv[i], &chunk_size) || (chunk_size < HONK_IO_MIN_BUFFER_SIZE) || (chunk_size > HONK_V2_MAX_CHUNK_SIZE))
+			{
+				fprintf(stderr, "Usage: -c <chunk size> (4K ... 1G, e.g. 4M)\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--v2") == 0)
+		{
+			//Write a v2 container with a chunk table:
+			format = HONK_FORMAT_V2;
+		}
+		else if (strcmp(arg, "--compat") == 0)
+		{
+			//Split long runs and blocks into short tokens, so decoders without escapes can read the output (the default):
+			layout = HONK_LAYOUT_COMPAT;
+		}
+		else if (strcmp(arg, "--long") == 0)
+		{
+			//Write escapes for long runs and blocks. Decoders without escapes misread them, so they are opt-in:
+			layout = HONK_LAYOUT_LONG;
+		}
+		else if (strcmp(arg, "--wide") == 0)
+		{
+			//Write a v2 container with 15 bit counts in the tokens:
+			format = HONK_FORMAT_V2;
+			layout = HONK_LAYOUT_WIDE;
+		}
+		else if (strcmp(arg, "--build-index") == 0)
+		{
+			//Write a sidecar index for a legacy stream (with a checkpoint every chunk size):
+			is_index_mode = true;
+		}
+		else if (strcmp(arg, "--index") == 0)
+		{
+			//Sidecar index of the legacy stream to decompress:
+			if (++i == argc)
+			{
+				fprintf(stderr, "Usage: --index <sidecar path>\n");
+				exit(EXIT_FAILURE);
+			}
+
+			index_path = argv[i];
+		}
+		else if (strcmp(arg, "--offset") == 0)
+		{
+			//First decoded byte to write:
+			if ((++i == argc) || !parse_size(argv[i], &range_offset))
+			{
+				fprintf(stderr, "Usage: --offset <offset> (e.g. 4G)\n");
+				exit(EXIT_FAILURE);
+			}
+
+			is_range_mode = true;
+		}
+		else if (strcmp(arg, "--length") == 0)
+		{
+			//Number of decoded bytes to write:
+			if ((++i == argc) || !parse_size(argv[i], &range_length))
+			{
+				fprintf(stderr, "Usage: --length <length> (e.g. 64K)\n");
+				exit(EXIT_FAILURE);
+			}
+
+			is_range_mode = true;
+		}
+		else if (strcmp(arg, "--uring") == 0)
+		{
+			//Read ahead and write behind through io_uring:
+			is_async_mode = true;
+		}
+		else if (strcmp(arg, "--direct") == 0)
+		{
+			//Same, with O_DIRECT (bypassing the page cache):
+			is_async_mode = true;
+			is_direct_mode = true;
+		}
+		else if (strcmp(arg, "--pipeline") == 0)
+		{
+			//Read ahead and write behind on threads of their own (works on pipes, too):
+			is_async_mode = true;
+			is_pipeline_mode = true;
+		}
+		else if (strcmp(arg, "--emit-header") == 0)
+		{
+			//Write a C/C++ header with the compressed input, named like the given identifier:
+			if ((++i == argc) || !is_identifier(argv[i]) || (strlen(argv[i]) > 200))
+			{
+				fprintf(stderr, "Usage: --emit-header <C identifier>\n");
+				exit(EXIT_FAILURE);
+			}
+
+			header_name = argv[i];
+		}
+		else if (strcmp(arg, "--vmsplice") == 0)
+		{
+			//Map the output pages into a pipe on stdout instead of copying them:
+			is_splice_mode = true;
+		}
+	}
+
+	//Ranges are only extracted while decompressing:
+	if (is_range_mode && is_compress_mode)
+	{
+		fprintf(stderr, "Usage: -d --offset <offset> --length <length>\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Headers are written while compressing:
+	if ((header_name != NULL) && !is_compress_mode)
+	{
+		fprintf(stderr, "Usage: --emit-header <C identifier> (without -d)\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//Compress in chunks? The v2 container is always written that way.
+	if (is_compress_mode && !is_index_mode && (header_name == NULL) && ((threads_count > 1) || (format == HONK_FORMAT_V2)))
+	{
+		honk_compress_parallel(get_stdin_binary(), get_stdout_binary(), threads_count, chunk_size, format, layout);
+		return 0;
 	}
 
-	//Get file pointers to stdin and stdout:
-	FILE* input = get_stdin_binary();
-	FILE* output = get_stdout_binary();
+	//Get buffered I/O on stdin and stdout.
+	//The chunk table of a v2 container is found relative to the initial offset of stdin.
+	honk_input_t input;
+	honk_output_t output;
+	off_t input_offset = honk_io_tell(get_stdin_binary());
 
-	//Compress / Decompress:
-	if (is_compress_mode)
+	//io_uring and the pipeline threads serve the streaming codecs, the parallel decoders access the file descriptors on their own:
+	is_async_mode = is_async_mode && (threads_count == 1) && (index_path == NULL);
+
+	if (is_async_mode && is_pipeline_mode)
+	{
+		honk_input_init_pipelined(&input, get_stdin_binary(), buffer_size);
+		honk_output_init_pipelined(&output, get_stdout_binary(), buffer_size);
+	}
+	else if (is_async_mode)
 	{
-		honk_compress(input, output);
+		honk_input_init_async(&input, get_stdin_binary(), buffer_size, is_direct_mode);
+		honk_output_init_async(&output, get_stdout_binary(), buffer_size, is_direct_mode);
+	}
+	else if (is_splice_mode)
+	{
+		honk_input_init(&input, get_stdin_binary(), buffer_size);
+		honk_output_init_spliced(&output, get_stdout_binary(), buffer_size);
 	}
 	else
 	{
-		honk_decompress(input, output);
+		honk_input_init(&input, get_stdin_binary(), buffer_size);
+		honk_output_init(&output, get_stdout_binary(), buffer_size);
 	}
 
-	//Did we leave the loop because of a read error?
-	if (ferror(input))
+	if (!is_compress_mode && !is_index_mode && (header_name == NULL))
 	{
-		fprintf(stderr, "Error while reading from input file descriptor.\n");
-		exit(EXIT_FAILURE);
+		honk_output_enable_sparse(&output);
+	}
+
+	//Compress / Decompress (v2 containers are detected automatically):
+	if (is_index_mode)
+	{
+		honk_build_index(&input, output.fd, chunk_size);
+	}
+	else if (header_name != NULL)
+	{
+		honk_emit_header(&input, &output, header_name);
+	}
+	else if (is_compress_mode)
+	{
+		//Regular files are mapped (unless they are read asynchronously), everything else is read:
+		if (is_async_mode || !honk_compress_mapped(input.fd, input_offset, &output, layout))
+		{
+			honk_compress(&input, &output, layout);
+		}
+	}
+	else if (is_range_mode)
+	{
+		honk_extract(&input, &output, input_offset, index_path, range_offset, range_length);
+	}
+	else if (is_async_mode || !honk_decompress_into_mapping(input.fd, input_offset, output.fd, index_path, threads_count, chunk_size))
+	{
+		//Everything but file to file goes through the buffers:
+		if ((threads_count > 1) || (index_path != NULL))
+		{
+			honk_decompress_threaded(&input, &output, input_offset, index_path, threads_count, chunk_size);
+		}
+		else
+		{
+			honk_decompress(&input, &output);
+		}
 	}
 
-	//Close the streams:
-	fclose(input);
-	fclose(output);
+	//Flush and close the streams:
+	honk_output_destroy(&output);
+	honk_input_destroy(&input);
 
 	return 0;
 }
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "honk.h"
+
+//Largest test input (64 KiB):
+#define MAX_INPUT_SIZE ((size_t)1 << 16)
+
+//Largest handmade container:
+#define MAX_CONTAINER_SIZE ((size_t)1 << 12)
+
+//A chunk of a handmade v2 container: its tokens (or its stored bytes) and the number of bytes they decode to.
+typedef struct __test_chunk_t__
+{
+	const char* payload;
+	size_t payload_size;
+	size_t uncompressed_size;
+	bool is_stored;
+} test_chunk_t;
+
+static int failed_count = 0;
+
+//Report a failed check:
+static void check(int is_passed, const char* what, size_t size);
+
+//Fill an input with a mix of runs and literals (or with a single long run), depending on the pattern:
+static void fill_input(uint8_t* input, size_t size, int pattern);
+
+//Compress / decompress through a stream, passing the input in pieces of piece_size bytes and taking the output in pieces of out_piece_size bytes.
+//Returns the output size or an error.
+static int64_t run_stream(honk_stream_mode_t mode, uint32_t flags, const uint8_t* in, size_t in_count, uint8_t* out, size_t out_capacity, size_t piece_size, size_t out_piece_size);
+
+//Expand the tokens of a stream with the token iterator. Returns the expanded size or an error.
+static int64_t expand_tokens(const uint8_t* src, size_t src_count, uint8_t* dst, size_t dst_capacity);
+
+//Store little endian numbers:
+static void store_le32(uint8_t* dst, uint32_t value);
+static void store_le64(uint8_t* dst, uint64_t value);
+
+//Write a v2 container with the given chunks, the end of chunks, the chunk table and the footer. Returns its size.
+static size_t write_container(uint8_t* dst, const test_chunk_t* chunks, size_t chunks_count, uint32_t chunk_size, bool is_wide);
+
+//Test all functions on an input of the given size, compressed with the given flags:
+static void test_input(const uint8_t* input, size_t size, uint32_t flags);
+
+//Test that long tokens are only written when they are asked for:
+static void test_long_tokens(void);
+
+//Test truncated streams, which must be reported as broken:
+static void test_truncated(void);
+
+//Test the token iterator on handmade containers (with status bytes, status words and stored chunks):
+static void test_container_tokens(void);
+
+//Write a container to a temporary file after prefix_size bytes of padding. Returns its file descriptor (the file is already unlinked).
+static int write_temporary_file(const uint8_t* container, size_t size, size_t prefix_size);
+
+//Test readers on a handmade container (reads across chunks and at the end, the cache and the prefetch):
+static void test_reader(void);
+
+static void check(int is_passed, const char* what, size_t size)
+{
+	if (!is_passed)
+	{
+		printf("FAILED: %s (%zu bytes)\n", what, size);
+		failed_count++;
+	}
+}
+
+static void fill_input(uint8_t* input, size_t size, int pattern)
+{
+	uint32_t state = 12345;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		state = state * 1103515245 + 12345;
+
+		switch (pattern)
+		{
+		case 0:
+			input[i] = (uint8_t)(state >> 16);
+			break;
+
+		case 1:
+			input[i] = ((i / 100) % 2 == 0) ? 'x' : (uint8_t)(state >> 16);
+			break;
+
+		default:
+			input[i] = 0;
+			break;
+		}
+	}
+}
+
+static int64_t run_stream(honk_stream_mode_t mode, uint32_t flags, const uint8_t* in, size_t in_count, uint8_t* out, size_t out_capacity, size_t piece_size, size_t out_piece_size)
+{
+	honk_stream_t* stream = honk_stream_create(mode, flags);
+	size_t in_pos = 0;
+	size_t out_count = 0;
+	int64_t result = 0;
+
+	if (stream == NULL)
+	{
+		return HONK_ERROR_BAD_FORMAT;
+	}
+
+	while ((result >= 0) && (in_pos < in_count))
+	{
+		size_t in_size = (in_count - in_pos < piece_size) ? (in_count - in_pos) : piece_size;
+		size_t out_size = (out_capacity - out_count < out_piece_size) ? (out_capacity - out_count) : out_piece_size;
+		size_t in_consumed = 0;
+
+		result = honk_stream_update(stream, in + in_pos, in_size, &in_consumed, out + out_count, out_size);
+
+		//A stream that takes no input and writes no output is stuck (on a full output, as the caller has no more room):
+		if ((result == 0) && (in_consumed == 0))
+		{
+			result = (out_size == 0) ? HONK_ERROR_DST_TOO_SMALL : HONK_ERROR_BAD_FORMAT;
+		}
+
+		in_pos += in_consumed;
+		out_count += (result > 0) ? (size_t)result : 0;
+	}
+
+	while (result >= 0)
+	{
+		size_t out_size = (out_capacity - out_count < out_piece_size) ? (out_capacity - out_count) : out_piece_size;
+		result = honk_stream_finish(stream, out + out_count, out_size);
+
+		//The stream reports itself if its output does not fit:
+		if (result == 0)
+		{
+			result = (int64_t)out_count;
+			break;
+		}
+
+		out_count += (result > 0) ? (size_t)result : 0;
+	}
+
+	honk_stream_destroy(stream);
+
+	return result;
+}
+
+static int64_t expand_tokens(const uint8_t* src, size_t src_count, uint8_t* dst, size_t dst_capacity)
+{
+	honk_token_iterator_t iterator;
+	honk_token_view_t token;
+	size_t dst_count = 0;
+	int64_t result;
+
+	honk_token_iterator_init(&iterator, src, src_count);
+
+	while ((result = honk_token_iterator_next(&iterator, &token)) == 1)
+	{
+		if ((token.count == 0) || (token.count > dst_capacity - dst_count))
+		{
+			return HONK_ERROR_DST_TOO_SMALL;
+		}
+
+		if (token.is_run)
+		{
+			memset(dst + dst_count, token.byte, (size_t)token.count);
+		}
+		else
+		{
+			memcpy(dst + dst_count, token.bytes, (size_t)token.count);
+		}
+
+		dst_count += (size_t)token.count;
+	}
+
+	return (result < 0) ? result : (int64_t)dst_count;
+}
+
+static void store_le32(uint8_t* dst, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		dst[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+static void store_le64(uint8_t* dst, uint64_t value)
+{
+	store_le32(dst, (uint32_t)value);
+	store_le32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static size_t write_container(uint8_t* dst, const test_chunk_t* chunks, size_t chunks_count, uint32_t chunk_size, bool is_wide)
+{
+	uint64_t offsets[16][2];
+	uint64_t total_size = 0;
+	size_t pos = 24;
+
+	//Header:
+	memcpy(dst, "\0HONK\r\n\x1A", 8);
+	dst[8] = 2;
+	dst[9] = is_wide ? 1 : 0;
+	dst[10] = 0;
+	dst[11] = 0;
+	store_le32(dst + 12, chunk_size);
+
+	//Chunks and the end of chunks:
+	for (size_t i = 0; i < chunks_count; i++)
+	{
+		offsets[i][0] = pos;
+		offsets[i][1] = total_size;
+
+		store_le32(dst + pos, (uint32_t)chunks[i].payload_size | (chunks[i].is_stored ? ((uint32_t)1 << 31) : 0));
+		store_le32(dst + pos + 4, (uint32_t)chunks[i].uncompressed_size);
+		memcpy(dst + pos + 8, chunks[i].payload, chunks[i].payload_size);
+
+		pos += 8 + chunks[i].payload_size;
+		total_size += chunks[i].uncompressed_size;
+	}
+
+	memset(dst + pos, 0, 8);
+	pos += 8;
+
+	store_le64(dst + 16, total_size);
+
+	//Chunk table and footer:
+	uint64_t table_offset = pos;
+
+	for (size_t i = 0; i < chunks_count; i++)
+	{
+		store_le64(dst + pos, offsets[i][0]);
+		store_le64(dst + pos + 8, offsets[i][1]);
+		pos += 16;
+	}
+
+	store_le64(dst + pos, table_offset);
+	store_le64(dst + pos + 8, chunks_count);
+	store_le64(dst + pos + 16, total_size);
+	memcpy(dst + pos + 24, "HONKIDX\0", 8);
+
+	return pos + 32;
+}
+
+static void test_input(const uint8_t* input, size_t size, uint32_t flags)
+{
+	size_t bound = honk_compress_bound(size);
+	uint8_t* packed = malloc(bound + 1);
+	uint8_t* streamed = malloc(bound + 1);
+	uint8_t* output = malloc(size + 1);
+
+	if ((packed == NULL) || (streamed == NULL) || (output == NULL))
+	{
+		fprintf(stderr, "Error while allocating buffers.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	//A destination of the bound is large enough:
+	int64_t packed_size = honk_compress_buffer(input, size, packed, bound, flags);
+	check((packed_size >= 0) && ((size_t)packed_size <= bound), "compress into the bound", size);
+
+	if (packed_size < 0)
+	{
+		free(packed);
+		free(streamed);
+		free(output);
+
+		return;
+	}
+
+	check((honk_decompress_buffer(packed, (size_t)packed_size, output, size) == (int64_t)size) && (memcmp(output, input, size) == 0), "decompress", size);
+
+	//Without flags, there are no escape tokens (their status bytes are 0x00 and 0x80):
+	for (int64_t i = 0; (flags == 0) && (i < packed_size); i += (packed[i] & 0x80) ? 2 : (packed[i] + 1))
+	{
+		if ((packed[i] & 0x7F) == 0)
+		{
+			check(0, "compress without escape tokens", size);
+			break;
+		}
+	}
+
+	//A destination that is one byte too small is reported as such:
+	if (packed_size > 0)
+	{
+		check(honk_compress_buffer(input, size, packed, (size_t)packed_size - 1, flags) == HONK_ERROR_DST_TOO_SMALL, "compress into a too small destination", size);
+		check(honk_compress_buffer(input, size, packed, bound, flags) == packed_size, "compress after a too small destination", size);
+	}
+
+	if (size > 0)
+	{
+		check(honk_decompress_buffer(packed, (size_t)packed_size, output, size - 1) == HONK_ERROR_DST_TOO_SMALL, "decompress into a too small destination", size);
+	}
+
+	//Streams write the same bytes, however the input and the output are cut into pieces:
+	static const size_t piece_sizes[] = { 1, 7, 4096, MAX_INPUT_SIZE };
+
+	for (size_t i = 0; i < sizeof(piece_sizes) / sizeof(piece_sizes[0]); i++)
+	{
+		size_t piece_size = piece_sizes[i];
+		size_t out_piece_size = piece_sizes[(i + 1) % (sizeof(piece_sizes) / sizeof(piece_sizes[0]))];
+
+		int64_t streamed_size = run_stream(HONK_STREAM_COMPRESS, flags, input, size, streamed, bound, piece_size, out_piece_size);
+		check((streamed_size == packed_size) && (memcmp(streamed, packed, (size_t)packed_size) == 0), "stream compress in pieces", size);
+
+		memset(output, 0, size);
+		check((run_stream(HONK_STREAM_DECOMPRESS, 0, packed, (size_t)packed_size, output, size, piece_size, out_piece_size) == (int64_t)size) && (memcmp(output, input, size) == 0), "stream decompress in pieces", size);
+	}
+
+	if (size > 0)
+	{
+		check(run_stream(HONK_STREAM_DECOMPRESS, 0, packed, (size_t)packed_size, output, size - 1, 4096, 4096) == HONK_ERROR_DST_TOO_SMALL, "stream decompress into a too small destination", size);
+	}
+
+	//The tokens expand to the input:
+	memset(output, 0, size);
+	check((expand_tokens(packed, (size_t)packed_size, output, size) == (int64_t)size) && (memcmp(output, input, size) == 0), "token iterator", size);
+
+	//Older decoders took a trailing 0x00 for an empty block, so it still ends a stream:
+	packed[packed_size] = 0x00;
+
+	check(expand_tokens(packed, (size_t)packed_size + 1, output, size) == (int64_t)size, "token iterator with a trailing empty block", size);
+
+	check(honk_decompress_buffer(packed, (size_t)packed_size + 1, output, size) == (int64_t)size, "decompress with a trailing empty block", size);
+	check(run_stream(HONK_STREAM_DECOMPRESS, 0, packed, (size_t)packed_size + 1, output, size, 1, 4096) == (int64_t)size, "stream decompress with a trailing empty block", size);
+
+	free(packed);
+	free(streamed);
+	free(output);
+}
+
+static void test_long_tokens(void)
+{
+	//A long run takes a single escape token instead of a run token per 127 bytes:
+	static uint8_t input[MAX_INPUT_SIZE];
+	static uint8_t packed[MAX_INPUT_SIZE];
+
+	memset(input, 'x', sizeof(input));
+
+	int64_t compat_size = honk_compress_buffer(input, sizeof(input), packed, sizeof(packed), 0);
+	int64_t long_size = honk_compress_buffer(input, sizeof(input), packed, sizeof(packed), HONK_FLAG_LONG_TOKENS);
+
+	check((compat_size == 2 * ((sizeof(input) + 126) / 127)) && (long_size > 0) && (long_size < 8), "compress a long run with and without escape tokens", sizeof(input));
+}
+
+static void test_truncated(void)
+{
+	//A block of ten bytes and a run of a hundred zeros:
+	uint8_t input[110];
+	uint8_t packed[64];
+	uint8_t output[sizeof(input)];
+
+	memcpy(input, "0123456789", 10);
+	memset(input + 10, 0, 100);
+
+	int64_t packed_size = honk_compress_buffer(input, sizeof(input), packed, sizeof(packed), 0);
+	check(packed_size > 0, "compress the truncation sample", sizeof(input));
+
+	//Cut off within the block and within the run:
+	static const size_t cut_sizes[] = { 1, 5, 10, 12 };
+
+	for (size_t i = 0; (packed_size > 0) && (i < sizeof(cut_sizes) / sizeof(cut_sizes[0])); i++)
+	{
+		size_t cut_size = cut_sizes[i];
+
+		check(honk_decompress_buffer(packed, cut_size, output, sizeof(output)) == HONK_ERROR_BAD_FORMAT, "decompress a truncated stream", cut_size);
+		check(run_stream(HONK_STREAM_DECOMPRESS, 0, packed, cut_size, output, sizeof(output), 1, 1) == HONK_ERROR_BAD_FORMAT, "stream decompress a truncated stream", cut_size);
+		check(expand_tokens(packed, cut_size, output, sizeof(output)) == HONK_ERROR_BAD_FORMAT, "token iterator on a truncated stream", cut_size);
+	}
+
+	check(expand_tokens(packed, (size_t)packed_size - 1, output, sizeof(output)) == HONK_ERROR_BAD_FORMAT, "token iterator on a stream without its last byte", sizeof(input));
+}
+
+static void test_container_tokens(void)
+{
+	//"aaabcdef", "ghijklmn" (stored) and "zz" as a run, a block, a stored chunk and a run:
+	static const char* const expected = "aaabcdefghijklmnzz";
+	static const test_chunk_t byte_chunks[] = { { "\x83" "a" "\x05" "bcdef", 8, 8, false }, { "ghijklmn", 8, 8, true }, { "\x82" "z", 2, 2, false } };
+	static const test_chunk_t word_chunks[] = { { "\x03\x80" "a" "\x05\x00" "bcdef", 10, 8, false }, { "ghijklmn", 8, 8, true }, { "\x02\x80" "z", 3, 2, false } };
+
+	uint8_t container[MAX_CONTAINER_SIZE];
+	uint8_t output[32];
+
+	for (int is_wide = 0; is_wide < 2; is_wide++)
+	{
+		size_t size = write_container(container, is_wide ? word_chunks : byte_chunks, 3, 8, is_wide);
+
+		check((expand_tokens(container, size, output, sizeof(output)) == 18) && (memcmp(output, expected, 18) == 0), "token iterator on a container", size);
+		check((honk_decompress_buffer(container, size, output, sizeof(output)) == 18) && (memcmp(output, expected, 18) == 0), "decompress a container", size);
+
+		//The chunks yield a run, a literal, the stored chunk as a literal and a run:
+		honk_token_iterator_t iterator;
+		honk_token_view_t token;
+		char kinds[8] = { 0 };
+		size_t count = 0;
+
+		honk_token_iterator_init(&iterator, container, size);
+
+		while ((count < sizeof(kinds) - 1) && (honk_token_iterator_next(&iterator, &token) == 1))
+		{
+			kinds[count++] = token.is_run ? 'r' : 'l';
+		}
+
+		check((strcmp(kinds, "rllr") == 0) && (iterator.error == 0), "token kinds of a container", size);
+
+		//Cut off within a chunk:
+		check(expand_tokens(container, 24 + 8 + 4, output, sizeof(output)) == HONK_ERROR_BAD_FORMAT, "token iterator on a truncated container", size);
+	}
+
+	//A chunk whose tokens decode to less than its size:
+	static const test_chunk_t short_chunks[] = { { "\x83" "a", 2, 4, false } };
+	size_t size = write_container(container, short_chunks, 1, 8, false);
+
+	check(expand_tokens(container, size, output, sizeof(output)) == HONK_ERROR_BAD_FORMAT, "token iterator on a chunk of the wrong size", size);
+}
+
+static int write_temporary_file(const uint8_t* container, size_t size, size_t prefix_size)
+{
+	char path[] = "/tmp/honk_api_test_XXXXXX";
+	int fd = mkstemp(path);
+
+	if (fd < 0)
+	{
+		fprintf(stderr, "Error while creating a temporary file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	unlink(path);
+
+	uint8_t padding[64] = { 0 };
+
+	if ((prefix_size > sizeof(padding)) || (write(fd, padding, prefix_size) != (ssize_t)prefix_size) || (write(fd, container, size) != (ssize_t)size))
+	{
+		fprintf(stderr, "Error while writing a temporary file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return fd;
+}
+
+static void test_reader(void)
+{
+	//Six chunks of 8 bytes (the last one is shorter) as runs, literals and stored chunks:
+	static const char* const expected = "aaaaaaaabcdefghijklmnopqrrrrsssstuvwxyz0123";
+	static const test_chunk_t chunks[] =
+	{
+		{ "\x88" "a", 2, 8, false },
+		{ "\x08" "bcdefghi", 9, 8, false },
+		{ "jklmnopq", 8, 8, true },
+		{ "\x84" "r" "\x84" "s", 4, 8, false },
+		{ "tuvwxyz0", 8, 8, true },
+		{ "\x03" "123", 4, 3, false }
+	};
+
+	uint8_t container[MAX_CONTAINER_SIZE];
+	uint8_t output[64];
+	size_t size = write_container(container, chunks, 6, 8, false);
+	int fd = write_temporary_file(container, size, 16);
+
+	honk_reader_t* reader = honk_reader_open_fd(fd, 16, HONK_READER_DEFAULT_CACHE_SIZE);
+	check(reader != NULL, "open a reader", size);
+
+	if (reader == NULL)
+	{
+		close(fd);
+		return;
+	}
+
+	check(honk_reader_size(reader) == 43, "size of a reader", size);
+
+	//Reads that start and end anywhere, crossing chunks:
+	for (uint64_t offset = 0; offset <= 43; offset++)
+	{
+		for (size_t count = 0; count <= 43 - offset; count += 5)
+		{
+			memset(output, 0, sizeof(output));
+			check((honk_reader_pread(reader, output, count, offset) == (ssize_t)count) && (memcmp(output, expected + offset, count) == 0), "read across chunks", (size_t)offset);
+		}
+	}
+
+	//Reads at or past the end are short:
+	check((honk_reader_pread(reader, output, 10, 38) == 5) && (memcmp(output, "z0123", 5) == 0), "read over the end", size);
+	check(honk_reader_pread(reader, output, 10, 43) == 0, "read at the end", size);
+	check(honk_reader_pread(reader, output, 10, 1000) == 0, "read past the end", size);
+	honk_reader_close(reader);
+
+	//With two slots, chunks 0, 2, 0 (a hit), 4 (which evicts 2) and 2 again (which is decoded again).
+	//None of them are adjacent, so nothing is prefetched:
+	static const uint64_t offsets[] = { 0, 16, 0, 32, 16 };
+
+	reader = honk_reader_open_fd(fd, 16, 2);
+	check(reader != NULL, "open a reader with two slots", size);
+
+	if (reader != NULL)
+	{
+		for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+		{
+			check((honk_reader_pread(reader, output, 8, offsets[i]) == 8) && (memcmp(output, expected + offsets[i], 8) == 0), "read a chunk", (size_t)offsets[i]);
+		}
+
+		honk_reader_stats_t stats;
+		honk_reader_get_stats(reader, &stats);
+		check((stats.hits == 1) && (stats.loads == 4) && (stats.prefetches == 0), "cache hits and evictions", size);
+		honk_reader_close(reader);
+	}
+
+	//Reading chunks 0 and 1 looks sequential, so chunk 2 is decoded ahead and the next read finds it:
+	reader = honk_reader_open_fd(fd, 16, 2);
+	check(reader != NULL, "open a reader for prefetching", size);
+
+	if (reader != NULL)
+	{
+		honk_reader_stats_t stats;
+
+		check(honk_reader_pread(reader, output, 8, 0) == 8, "read the first chunk", size);
+		check(honk_reader_pread(reader, output, 8, 8) == 8, "read the second chunk", size);
+
+		for (int i = 0; i < 5000; i++)
+		{
+			honk_reader_get_stats(reader, &stats);
+
+			if (stats.prefetches > 0)
+			{
+				break;
+			}
+
+			usleep(1000);
+		}
+
+		check(stats.prefetches == 1, "prefetch the next chunk", size);
+		check((honk_reader_pread(reader, output, 8, 16) == 8) && (memcmp(output, expected + 16, 8) == 0), "read a prefetched chunk", size);
+
+		honk_reader_get_stats(reader, &stats);
+		check((stats.hits == 1) && (stats.loads == 2), "hit a prefetched chunk", size);
+		honk_reader_close(reader);
+	}
+
+	close(fd);
+
+	//A file without a chunk table cannot be opened:
+	fd = write_temporary_file(container, 24, 0);
+	check(honk_reader_open_fd(fd, 0, 2) == NULL, "open a reader without a chunk table", size);
+	close(fd);
+}
+
+int main(void)
+{
+	static const size_t sizes[] = { 0, 1, 2, 3, 127, 128, 129, 4096, 65535, MAX_INPUT_SIZE };
+	static const uint32_t flags[] = { 0, HONK_FLAG_LONG_TOKENS };
+	uint8_t* input = malloc(MAX_INPUT_SIZE);
+
+	if (input == NULL)
+	{
+		fprintf(stderr, "Error while allocating buffers.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int pattern = 0; pattern < 3; pattern++)
+	{
+		for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		{
+			fill_input(input, sizes[i], pattern);
+
+			for (size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); j++)
+			{
+				test_input(input, sizes[i], flags[j]);
+			}
+		}
+	}
+
+	test_long_tokens();
+	test_truncated();
+	test_container_tokens();
+	test_reader();
+	free(input);
+
+	if (failed_count > 0)
+	{
+		printf("%d checks failed.\n", failed_count);
+		return EXIT_FAILURE;
+	}
+
+	printf("All library checks passed.\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//The single definition of the asset (tests/asset_use.c includes the header without it):
+#define HONK_TEXT_IMPLEMENTATION
+#include "text_asset.h"
+
+//In the other source file:
+const unsigned char* get_text(void);
+
+int main(void)
+{
+	FILE* file = fopen("samples/text.txt", "rb");
+	unsigned char sample[TEXT_SIZE + 1];
+
+	if ((file == NULL) || (fread(sample, 1, sizeof(sample), file) != TEXT_SIZE))
+	{
+		fprintf(stderr, "Error while reading samples/text.txt.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(file);
+
+	if ((text_data() == NULL) || (get_text() != text_data()) || (memcmp(text_data(), sample, TEXT_SIZE) != 0))
+	{
+		printf("FAILED: decode the emitted asset in C\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("All C asset checks passed.\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+#include "text_asset.h"
+
+const unsigned char* get_text(void);
+
+const unsigned char* get_text(void)
+{
+	return text_data();
+}
@@ -0,0 +1,126 @@
+#!/bin/sh
+#Round-trips the samples through honkpack and compares the legacy streams with the committed .honk files.
+#Usage: tests/check.sh <path to honkpack>
+
+HONKPACK="$1"
+SAMPLES="samples/document.pdf samples/picture.bmp samples/text.txt"
+TEMP=$(mktemp -d)
+FAILED=0
+
+trap 'rm -rf "$TEMP"' EXIT
+
+#Report a failed check:
+fail()
+{
+	echo "FAILED: $1"
+	FAILED=1
+}
+
+#Compress with the given options and compare with the committed stream:
+check_stream()
+{
+	"$HONKPACK" $2 < "$1" > "$TEMP/out.honk" && cmp -s "$TEMP/out.honk" "$1.honk" || fail "$1: honkpack $2 differs from $1.honk"
+}
+
+#Compress with the given options, decompress with the other ones and compare with the sample:
+check_round_trip()
+{
+	"$HONKPACK" $2 < "$1" > "$TEMP/out.honk" && "$HONKPACK" -d $3 < "$TEMP/out.honk" > "$TEMP/out" && cmp -s "$TEMP/out" "$1" || fail "$1: honkpack $2 | honkpack -d $3"
+}
+
+#Decompress a range of a stream with the given options and compare with the same range of the sample:
+check_range()
+{
+	tail -c +$(($3 + 1)) "$1" | head -c "$4" > "$TEMP/expected"
+	"$HONKPACK" -d $5 --offset "$3" --length "$4" < "$2" > "$TEMP/out" && cmp -s "$TEMP/out" "$TEMP/expected" || fail "$1: honkpack -d $5 --offset $3 --length $4"
+}
+
+for SAMPLE in $SAMPLES
+do
+	SIZE=$(wc -c < "$SAMPLE")
+
+	#Legacy streams match the committed ones:
+	check_stream "$SAMPLE" ""
+
+	"$HONKPACK" -d < "$SAMPLE.honk" > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d < $SAMPLE.honk"
+
+	check_round_trip "$SAMPLE" "" ""
+
+	#Stitched chunks of several threads match the serial stream (the chunks of the samples are short enough to synchronize):
+	check_stream "$SAMPLE" "-T 3 -c 4K"
+	check_round_trip "$SAMPLE" "-T 3 -c 4K" ""
+
+	#Legacy streams are cut into pieces at their token boundaries and decoded on several threads:
+	check_round_trip "$SAMPLE" "" "-T 3 -c 4K"
+	cat "$SAMPLE.honk" | "$HONKPACK" -d -T 3 -c 4K | cat > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d -T 3 -c 4K on pipes"
+
+	#V2 containers, decoded along their chunk table on several threads and chunk by chunk from a pipe:
+	check_round_trip "$SAMPLE" "--v2 -c 4K" ""
+	check_round_trip "$SAMPLE" "--v2 -c 4K" "-T 3"
+	"$HONKPACK" --v2 -c 4K < "$SAMPLE" | "$HONKPACK" -d | cat > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack --v2 -c 4K | honkpack -d"
+
+	#Legacy streams along a sidecar index:
+	"$HONKPACK" --build-index -c 4K < "$SAMPLE.honk" > "$TEMP/out.honk.idx" || fail "$SAMPLE: honkpack --build-index"
+	"$HONKPACK" -d -T 3 --index "$TEMP/out.honk.idx" < "$SAMPLE.honk" > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d -T 3 --index"
+
+	#Ranges along the sidecar index, the chunk table of a v2 container and (without either) through the whole stream.
+	#They start and end within chunks, at the end of the sample and behind it:
+	"$HONKPACK" --v2 -c 4K < "$SAMPLE" > "$TEMP/v2.honk" || fail "$SAMPLE: honkpack --v2"
+
+	for RANGE in "0 1" "1000 5000" "$((SIZE / 2)) $SIZE" "$((SIZE - 1)) 1" "$SIZE 1"
+	do
+		check_range "$SAMPLE" "$SAMPLE.honk" $RANGE "--index $TEMP/out.honk.idx"
+		check_range "$SAMPLE" "$TEMP/v2.honk" $RANGE ""
+		check_range "$SAMPLE" "$SAMPLE.honk" $RANGE ""
+	done
+
+	#Read ahead and written behind through io_uring (the sandbox may lack it, then honkpack falls back to read() and write()):
+	check_stream "$SAMPLE" "--uring"
+	check_round_trip "$SAMPLE" "--uring" "--uring"
+	check_round_trip "$SAMPLE" "--uring" "--direct"
+
+	#On the threads of the pipeline:
+	check_stream "$SAMPLE" "--pipeline"
+	check_round_trip "$SAMPLE" "--pipeline" "--pipeline"
+
+	#Mapped into a pipe:
+	"$HONKPACK" --vmsplice < "$SAMPLE" | cat > "$TEMP/out.honk" && cmp -s "$TEMP/out.honk" "$SAMPLE.honk" || fail "$SAMPLE: honkpack --vmsplice differs from $SAMPLE.honk"
+	"$HONKPACK" -d --vmsplice < "$SAMPLE.honk" | cat > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d --vmsplice"
+
+	#The compressed samples hardly compress again, so their chunks are stored (and copied file to file when decoded):
+	check_round_trip "$SAMPLE.honk" "--v2 -c 4K" ""
+	check_round_trip "$SAMPLE.honk" "--v2 -c 4K" "-T 3"
+
+	#Escape tokens for long runs and blocks, which --compat (the default) leaves out:
+	check_stream "$SAMPLE" "--compat"
+	check_round_trip "$SAMPLE" "--long" ""
+	check_round_trip "$SAMPLE" "--long -T 3 -c 4K" "-T 3 -c 4K"
+
+	#Older decoders took a trailing 0x00 for an empty block, so it still ends a stream:
+	{ cat "$SAMPLE.honk"; printf "\000"; } > "$TEMP/tail.honk"
+	"$HONKPACK" -d < "$TEMP/tail.honk" > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d with a trailing empty block"
+	"$HONKPACK" -d -T 3 -c 4K < "$TEMP/tail.honk" > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d -T 3 -c 4K with a trailing empty block"
+
+	#Wide tokens (in v2 containers only):
+	check_round_trip "$SAMPLE" "--wide -c 4K" ""
+	check_round_trip "$SAMPLE" "--wide -c 4K" "-T 3"
+
+	#Through pipes instead of files:
+	cat "$SAMPLE" | "$HONKPACK" | cat > "$TEMP/out.honk" && cmp -s "$TEMP/out.honk" "$SAMPLE.honk" || fail "$SAMPLE: honkpack on pipes differs from $SAMPLE.honk"
+	cat "$SAMPLE.honk" | "$HONKPACK" -d | cat > "$TEMP/out" && cmp -s "$TEMP/out" "$SAMPLE" || fail "$SAMPLE: honkpack -d on pipes"
+done
+
+#A sparse file: a hole of 1 MiB, a sample and zeros behind it (a hole at the end of the output is only there once it is resized):
+dd if=samples/text.txt of="$TEMP/sparse" bs=1024 seek=1024 2> /dev/null
+dd if=/dev/zero bs=65536 count=4 2> /dev/null >> "$TEMP/sparse"
+
+check_round_trip "$TEMP/sparse" "" ""
+check_round_trip "$TEMP/sparse" "-T 3 -c 4K" "-T 3 -c 4K"
+check_round_trip "$TEMP/sparse" "--v2 -c 4K" "-T 3"
+
+if [ $FAILED -ne 0 ]
+then
+	exit 1
+fi
+
+echo "All round trips passed."
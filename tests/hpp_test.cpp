@@ -0,0 +1,264 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "honk.hpp"
+
+//Written by honkpack --emit-header text < samples/text.txt:
+#include "text_asset.h"
+
+//Built as C++17 and as C++20, which adds the compile-time parts of honk.hpp.
+
+namespace
+{
+	//A symbol whose size is no power of two:
+	struct rgb_t
+	{
+		std::uint8_t r;
+		std::uint8_t g;
+		std::uint8_t b;
+	};
+
+	int failed_count = 0;
+
+	//Report a failed check:
+	void check(bool is_passed, const char* what, const char* name, std::size_t count)
+	{
+		if (!is_passed)
+		{
+			std::printf("FAILED: %s (%s, %zu symbols)\n", what, name, count);
+			failed_count++;
+		}
+	}
+
+	//Make a symbol from the low bytes of a value:
+	template <typename Symbol>
+	Symbol make_symbol(std::uint32_t value)
+	{
+		Symbol symbol{};
+		std::memcpy(&symbol, &value, (sizeof(Symbol) < sizeof(value)) ? sizeof(Symbol) : sizeof(value));
+
+		return symbol;
+	}
+
+	//Runs of up to 300 symbols between literals of a small alphabet (so they contain pairs), and a run that is longer than any token:
+	template <typename Symbol>
+	std::vector<Symbol> make_symbols(std::size_t count)
+	{
+		std::vector<Symbol> symbols(count);
+		std::uint32_t state = 12345;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			state = state * 1103515245 + 12345;
+
+			bool is_run = ((i / 300) % 3 == 0) || ((i >= 1000) && (i < 40000));
+			symbols[i] = (is_run && (i > 0)) ? symbols[i - 1] : make_symbol<Symbol>((state >> 16) % 5);
+		}
+
+		return symbols;
+	}
+
+	//Round-trip the symbols and check the errors of the codec:
+	template <typename Symbol, std::size_t MaxCount>
+	void test_codec(const char* name, const std::vector<Symbol>& symbols)
+	{
+		using codec = honk::codec<Symbol, MaxCount>;
+
+		std::size_t count = symbols.size();
+		std::vector<std::uint8_t> packed(codec::compress_bound(count) + 1);
+		std::vector<Symbol> output(count + 1);
+
+		std::int64_t packed_size = codec::compress(symbols.data(), count, packed.data(), packed.size() - 1);
+		check((packed_size >= 0) && (static_cast<std::size_t>(packed_size) <= codec::compress_bound(count)), "compress into the bound", name, count);
+
+		if (packed_size < 0)
+		{
+			return;
+		}
+
+		check((codec::decompress(packed.data(), static_cast<std::size_t>(packed_size), output.data(), count) == static_cast<std::int64_t>(count)) && (std::memcmp(output.data(), symbols.data(), count * sizeof(Symbol)) == 0), "decompress", name, count);
+
+		if (packed_size > 0)
+		{
+			check(codec::compress(symbols.data(), count, packed.data(), static_cast<std::size_t>(packed_size) - 1) == HONK_ERROR_DST_TOO_SMALL, "compress into a too small destination", name, count);
+			check(codec::decompress(packed.data(), static_cast<std::size_t>(packed_size), output.data(), count - 1) == HONK_ERROR_DST_TOO_SMALL, "decompress into a too small destination", name, count);
+			check(codec::decompress(packed.data(), static_cast<std::size_t>(packed_size) - 1, output.data(), count) == HONK_ERROR_BAD_FORMAT, "decompress a truncated stream", name, count);
+		}
+	}
+
+	//codec<uint8_t> writes the streams of libhonk without flags:
+	void test_bytes(const std::vector<std::uint8_t>& bytes)
+	{
+		std::vector<std::uint8_t> packed(honk_compress_bound(bytes.size()));
+		std::vector<std::uint8_t> library_packed(honk_compress_bound(bytes.size()));
+
+		std::int64_t packed_size = honk::codec<std::uint8_t>::compress(bytes.data(), bytes.size(), packed.data(), packed.size());
+		std::int64_t library_size = honk_compress_buffer(bytes.data(), bytes.size(), library_packed.data(), library_packed.size(), 0);
+
+		check((packed_size == library_size) && (std::memcmp(packed.data(), library_packed.data(), static_cast<std::size_t>(library_size)) == 0), "compress like honk_compress_buffer()", "uint8_t", bytes.size());
+	}
+
+	//lazy_asset decodes once, however many threads ask for it at the same time:
+	void test_lazy_asset()
+	{
+		std::vector<std::uint8_t> bytes = make_symbols<std::uint8_t>(1000);
+		std::vector<std::uint8_t> packed(honk::codec<std::uint8_t>::compress_bound(bytes.size()));
+		std::int64_t packed_size = honk::codec<std::uint8_t>::compress(bytes.data(), bytes.size(), packed.data(), packed.size());
+
+		static std::uint8_t buffer[1000];
+		honk::lazy_asset<1000> asset(packed.data(), static_cast<std::size_t>(packed_size), buffer);
+		const std::uint8_t* data[4] = {};
+		std::vector<std::thread> threads;
+
+		for (const std::uint8_t*& thread_data : data)
+		{
+			threads.emplace_back([&asset, &thread_data]() { thread_data = asset.data(); });
+		}
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		check((data[0] == buffer) && (data[1] == buffer) && (data[2] == buffer) && (data[3] == buffer) && (std::memcmp(buffer, bytes.data(), bytes.size()) == 0), "decode a lazy asset", "uint8_t", bytes.size());
+
+		//An asset of the wrong size is broken:
+		static std::uint8_t short_buffer[999];
+		honk::lazy_asset<999> short_asset(packed.data(), static_cast<std::size_t>(packed_size), short_buffer);
+
+		check(short_asset.data() == nullptr, "decode a lazy asset of the wrong size", "uint8_t", bytes.size());
+	}
+
+	//The asset of honkpack --emit-header decodes to the sample:
+	void test_emitted_header()
+	{
+		std::ifstream file("samples/text.txt", std::ios::binary);
+		std::vector<char> sample((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		check((text.size() == sample.size()) && (text.data() != nullptr) && (std::memcmp(text.data(), sample.data(), sample.size()) == 0), "decode the emitted asset", "samples/text.txt", sample.size());
+	}
+
+#if __cplusplus >= 202002L
+	//An asset that is packed at compile time:
+	constexpr std::array<std::uint8_t, 1000> make_raw()
+	{
+		std::array<std::uint8_t, 1000> raw{};
+
+		for (std::size_t i = 0; i < raw.size(); i++)
+		{
+			raw[i] = static_cast<std::uint8_t>((i % 200 < 150) ? 'x' : i);
+		}
+
+		return raw;
+	}
+
+	constexpr std::array<std::uint8_t, 1000> raw = make_raw();
+	constexpr auto packed = honk::pack<honk::packed_size(raw)>(raw);
+
+	static_assert(packed.size() < raw.size() / 2, "The runs must be packed at compile time.");
+
+	std::uint8_t raw_buffer[raw.size()];
+	honk::lazy_asset<raw.size()> raw_asset(packed.data(), packed.size(), raw_buffer);
+
+	//token_view walks the tokens of libhonk again for every loop and for every copy:
+	void test_token_view()
+	{
+		static_assert(std::ranges::view<honk::token_view>, "token_view is a view.");
+		static_assert(std::forward_iterator<honk::token_view::iterator>, "Its iterators can be copied and compared.");
+
+		std::vector<std::uint8_t> bytes = make_symbols<std::uint8_t>(1000);
+		std::vector<std::uint8_t> packed(honk_compress_bound(bytes.size()));
+		std::int64_t packed_size = honk_compress_buffer(bytes.data(), bytes.size(), packed.data(), packed.size(), 0);
+
+		honk::token_view tokens(packed.data(), static_cast<std::size_t>(packed_size));
+		honk::token_view copy = tokens;
+		std::vector<std::uint8_t> output;
+
+		for (const honk_token_view_t& token : tokens)
+		{
+			if (token.is_run)
+			{
+				output.insert(output.end(), token.count, token.byte);
+			}
+			else
+			{
+				output.insert(output.end(), token.bytes, token.bytes + token.count);
+			}
+		}
+
+		check((output == bytes) && (tokens.error() == 0), "expand a token view", "uint8_t", bytes.size());
+		check(std::ranges::count_if(tokens, [](const honk_token_view_t& token) { return token.is_run; }) == std::ranges::count_if(copy, [](const honk_token_view_t& token) { return token.is_run; }), "count the runs of a copied token view", "uint8_t", bytes.size());
+
+		//The iterators are at the same token if they are at the same place:
+		auto it = tokens.begin();
+		auto other = tokens.begin();
+
+		check((it == other) && (++it != other) && (it == ++other), "compare token view iterators", "uint8_t", bytes.size());
+
+		//A view of broken tokens ends early and tells why:
+		honk::token_view broken(packed.data(), static_cast<std::size_t>(packed_size) - 1);
+
+		check(broken.error() == HONK_ERROR_BAD_FORMAT, "report a truncated token view", "uint8_t", bytes.size());
+	}
+
+	//The codec runs at compile time:
+	constexpr bool is_constexpr_round_trip()
+	{
+		using codec = honk::codec<std::uint16_t>;
+
+		std::array<std::uint16_t, 300> symbols{};
+
+		for (std::size_t i = 0; i < symbols.size(); i++)
+		{
+			symbols[i] = static_cast<std::uint16_t>((i < 200) ? 0xABCD : i);
+		}
+
+		std::array<std::uint8_t, codec::compress_bound(300)> packed{};
+		std::array<std::uint16_t, 300> output{};
+
+		std::int64_t packed_size = codec::compress(symbols.data(), symbols.size(), packed.data(), packed.size());
+
+		return (packed_size > 0) && (codec::decompress(packed.data(), static_cast<std::size_t>(packed_size), output.data(), output.size()) == 300) && (output == symbols);
+	}
+
+	static_assert(is_constexpr_round_trip(), "The codec must run at compile time.");
+#endif
+}
+
+int main()
+{
+	static const std::size_t counts[] = { 0, 1, 2, 3, 127, 128, 129, 1000, 70000 };
+
+	for (std::size_t count : counts)
+	{
+		test_codec<std::uint8_t, 127>("uint8_t", make_symbols<std::uint8_t>(count));
+		test_codec<std::uint8_t, 0x7FFF>("uint8_t, wide", make_symbols<std::uint8_t>(count));
+		test_codec<std::uint16_t, 127>("uint16_t", make_symbols<std::uint16_t>(count));
+		test_codec<rgb_t, 127>("rgb_t", make_symbols<rgb_t>(count));
+		test_codec<std::uint32_t, 0x7FFF>("uint32_t, wide", make_symbols<std::uint32_t>(count));
+
+		test_bytes(make_symbols<std::uint8_t>(count));
+	}
+
+	test_lazy_asset();
+	test_emitted_header();
+
+#if __cplusplus >= 202002L
+	test_token_view();
+	check((raw_asset.data() != nullptr) && (std::memcmp(raw_asset.data(), raw.data(), raw.size()) == 0), "decode an asset that is packed at compile time", "uint8_t", raw.size());
+#endif
+
+	if (failed_count > 0)
+	{
+		std::printf("%d checks failed.\n", failed_count);
+		return EXIT_FAILURE;
+	}
+
+	std::printf("All C++%ld checks passed.\n", __cplusplus / 100 % 100);
+	return EXIT_SUCCESS;
+}